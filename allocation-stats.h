@@ -0,0 +1,216 @@
+#ifndef ALLOCATION_STATS_H
+#define ALLOCATION_STATS_H
+
+#include <cstdlib>
+#include <ctime>
+#include <new>
+#include <stdint.h>
+
+/**
+ * \brief Counts the heap allocations of the program.
+ *
+ * The global operator new and delete below forward to malloc and free
+ * through this class, so every allocation of the simulation is seen:
+ * the Packet objects, buffers, tags and metadata of the traffic
+ * generators and bundle sends, the packets the sinks receive and
+ * drop, and the events scheduled for them.  Memory is never kept
+ * here; what a program recycles, it recycles itself (see PacketPool in
+ * bundle-delivery.h).
+ *
+ * Only the thread that called Start is counted, the one running the
+ * simulator, so counting is a plain increment; timing reads the clock
+ * twice per call and is enabled separately.
+ *
+ * Include this header from exactly one translation unit of a program:
+ * it defines the replacement operators.
+ */
+class AllocationStats
+{
+public:
+  /**
+   * \brief Starts counting from zero
+   * \param timing also accumulate the time spent allocating and freeing
+   * \return none
+   */
+  static void Start (bool timing);
+
+  /**
+   * \brief Stops counting
+   * \return none
+   */
+  static void Stop ();
+
+  /**
+   * \brief Returns the number of allocations counted
+   * \return the number of allocations
+   */
+  static uint64_t GetNAllocations ();
+
+  /**
+   * \brief Returns the number of bytes allocated
+   * \return the number of bytes
+   */
+  static uint64_t GetNBytes ();
+
+  /**
+   * \brief Returns the time spent allocating and freeing, if timed
+   * \return the time in milliseconds
+   */
+  static double GetAllocatorMs ();
+
+  /**
+   * \brief Prints the counts as one line
+   * \param os the output stream
+   * \return none
+   */
+  template <typename Stream>
+  static void Print (Stream &os);
+
+  /**
+   * \brief Allocates, counting the call
+   * \param size the number of bytes
+   * \return the memory
+   */
+  static void * Allocate (size_t size);
+
+  /**
+   * \brief Frees, timing the call
+   * \param p the memory
+   * \return none
+   */
+  static void Free (void *p);
+
+private:
+  /**
+   * \brief Returns a monotonic clock reading
+   * \return nanoseconds since an arbitrary origin
+   */
+  static uint64_t NowNs ();
+
+  static __thread bool t_counting;
+  static __thread bool t_timing;
+  static uint64_t g_nAllocations;
+  static uint64_t g_nBytes;
+  static uint64_t g_ns;
+};
+
+__thread bool AllocationStats::t_counting = false;
+__thread bool AllocationStats::t_timing = false;
+uint64_t AllocationStats::g_nAllocations = 0;
+uint64_t AllocationStats::g_nBytes = 0;
+uint64_t AllocationStats::g_ns = 0;
+
+void
+AllocationStats::Start (bool timing)
+{
+  g_nAllocations = 0;
+  g_nBytes = 0;
+  g_ns = 0;
+  t_timing = timing;
+  t_counting = true;
+}
+
+void
+AllocationStats::Stop ()
+{
+  t_counting = false;
+  t_timing = false;
+}
+
+uint64_t
+AllocationStats::GetNAllocations ()
+{
+  return g_nAllocations;
+}
+
+uint64_t
+AllocationStats::GetNBytes ()
+{
+  return g_nBytes;
+}
+
+double
+AllocationStats::GetAllocatorMs ()
+{
+  return g_ns / 1e6;
+}
+
+template <typename Stream>
+void
+AllocationStats::Print (Stream &os)
+{
+  os << "Allocations during Run: " << g_nAllocations << " (" << g_nBytes << " bytes)";
+  if (g_ns > 0)
+    {
+      os << ", allocator time " << GetAllocatorMs () << " ms";
+    }
+  os << "\n";
+}
+
+uint64_t
+AllocationStats::NowNs ()
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void *
+AllocationStats::Allocate (size_t size)
+{
+  uint64_t start = t_timing ? NowNs () : 0;
+  void *p = std::malloc (size > 0 ? size : 1);
+  if (p == NULL)
+    {
+      throw std::bad_alloc ();
+    }
+  if (t_counting)
+    {
+      g_nAllocations++;
+      g_nBytes += size;
+      if (start != 0)
+        {
+          g_ns += NowNs () - start;
+        }
+    }
+  return p;
+}
+
+void
+AllocationStats::Free (void *p)
+{
+  if (t_timing)
+    {
+      uint64_t start = NowNs ();
+      std::free (p);
+      g_ns += NowNs () - start;
+      return;
+    }
+  std::free (p);
+}
+
+void *
+operator new (size_t size)
+{
+  return AllocationStats::Allocate (size);
+}
+
+void *
+operator new[] (size_t size)
+{
+  return AllocationStats::Allocate (size);
+}
+
+void
+operator delete (void *p) throw ()
+{
+  AllocationStats::Free (p);
+}
+
+void
+operator delete[] (void *p) throw ()
+{
+  AllocationStats::Free (p);
+}
+
+#endif /* ALLOCATION_STATS_H */
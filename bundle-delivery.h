@@ -0,0 +1,236 @@
+#ifndef BUNDLE_DELIVERY_H
+#define BUNDLE_DELIVERY_H
+
+#include <algorithm>
+#include <set>
+#include <vector>
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/bp-endpoint-id.h"
+#include "ns3/bundle-protocol.h"
+
+// Delivery accounting, packet recycling and event-driven delivery
+// shared by the bundle examples; include from the one source file of
+// an example.
+
+using namespace ns3;
+
+// PDU latency: a PDU is delivered once all bytes up to its end arrived
+static uint32_t g_pduSize = 1000;
+static std::vector<Time> g_pduSendTimes;
+static uint64_t g_bytesReceived = 0;
+static uint32_t g_nPdusDelivered = 0;
+static Time g_totalLatency;
+static Time g_maxLatency;
+static uint64_t g_nReceiveCalls = 0;
+
+void AccountDelivery (uint32_t bytes)
+{
+  g_bytesReceived += bytes;
+  while (g_nPdusDelivered < g_pduSendTimes.size ()
+         && g_bytesReceived >= (uint64_t) (g_nPdusDelivered + 1) * g_pduSize)
+    {
+      Time latency = Simulator::Now () - g_pduSendTimes[g_nPdusDelivered++];
+      g_totalLatency += latency;
+      g_maxLatency = std::max (g_maxLatency, latency);
+    }
+}
+
+/**
+ * Recycles the Packet objects of bundle sends.  The sinks put back the
+ * packets they are done with; Get reuses one only once nothing else
+ * holds it, resetting it to a fresh packet of the requested size with
+ * a new uid, and otherwise creates one.  The pool lives on the
+ * simulator thread and holds at most its capacity of packets.
+ */
+class PacketPool
+{
+public:
+  PacketPool ()
+    : m_enabled (false),
+      m_capacity (256),
+      m_nReused (0),
+      m_nCreated (0)
+  {
+  }
+
+  void SetEnabled (bool enabled)
+  {
+    m_enabled = enabled;
+    if (!enabled)
+      {
+        m_free.clear ();
+      }
+  }
+
+  Ptr<Packet> Get (uint32_t size)
+  {
+    while (!m_free.empty ())
+      {
+        Ptr<Packet> p = m_free.back ();
+        m_free.pop_back ();
+        // still queued or kept somewhere, e.g. by a store
+        if (p->GetReferenceCount () == 1)
+          {
+            *p = Packet (size);
+            m_nReused++;
+            return p;
+          }
+      }
+    m_nCreated++;
+    return Create<Packet> (size);
+  }
+
+  void Put (Ptr<Packet> p)
+  {
+    if (m_enabled && m_free.size () < m_capacity)
+      {
+        m_free.push_back (p);
+      }
+  }
+
+  uint64_t GetNReused () const
+  {
+    return m_nReused;
+  }
+  uint64_t GetNCreated () const
+  {
+    return m_nCreated;
+  }
+
+private:
+  bool m_enabled;
+  uint32_t m_capacity;
+  std::vector<Ptr<Packet> > m_free;
+  uint64_t m_nReused;
+  uint64_t m_nCreated;
+};
+
+static PacketPool g_packetPool;
+
+/**
+ * Delivers bundles to per-endpoint callbacks as soon as they can be
+ * received, instead of polling BundleProtocol::Receive.  A packet
+ * delivered by IPv4 on a registered node schedules a drain at the end
+ * of the current event; each drain hands the waiting bundles over in
+ * calls of up to the registered batch size.
+ *
+ * The bundle layer need not finish a bundle within that event, so a
+ * drain is re-armed after the re-arm interval while drains keep
+ * finding bundles, and once more after the first that finds none.
+ */
+class BundleDeliveryDispatcher
+{
+public:
+  typedef Callback<void, BpEndpointId, const std::vector<Ptr<Packet> > &> DeliveryCallback;
+
+  BundleDeliveryDispatcher ()
+    : m_rearm (MilliSeconds (1)),
+      m_nIdleDrains (0),
+      m_nDrains (0),
+      m_nDeliveries (0)
+  {
+  }
+
+  void SetRearmInterval (Time interval)
+  {
+    m_rearm = interval;
+  }
+
+  void Register (Ptr<Node> node, Ptr<BundleProtocol> receiver, BpEndpointId eid,
+                 DeliveryCallback callback, uint32_t batch)
+  {
+    Registration registration;
+    registration.receiver = receiver;
+    registration.eid = eid;
+    registration.callback = callback;
+    registration.batch = std::max (batch, 1u);
+    m_registrations.push_back (registration);
+    if (m_nodes.insert (node->GetId ()).second)
+      {
+        node->GetObject<Ipv4L3Protocol> ()->TraceConnectWithoutContext (
+          "LocalDeliver", MakeCallback (&BundleDeliveryDispatcher::LocalDeliver, this));
+      }
+  }
+
+  // drains that found at least one bundle, and all of them
+  uint64_t GetNDeliveries () const
+  {
+    return m_nDeliveries;
+  }
+  uint64_t GetNDrains () const
+  {
+    return m_nDrains;
+  }
+
+private:
+  struct Registration
+  {
+    Ptr<BundleProtocol> receiver;
+    BpEndpointId eid;
+    DeliveryCallback callback;
+    uint32_t batch;
+  };
+
+  void LocalDeliver (const Ipv4Header &header, Ptr<const Packet> packet, uint32_t interface)
+  {
+    m_nIdleDrains = 0;
+    if (m_drain.IsRunning () && Simulator::GetDelayLeft (m_drain).IsZero ())
+      {
+        return;
+      }
+    // a re-armed drain would come later than needed
+    m_drain.Cancel ();
+    m_drain = Simulator::ScheduleNow (&BundleDeliveryDispatcher::Drain, this);
+  }
+
+  void Drain ()
+  {
+    m_nDrains++;
+    bool delivered = false;
+    for (uint32_t i = 0; i < m_registrations.size (); i++)
+      {
+        Registration &r = m_registrations[i];
+        std::vector<Ptr<Packet> > bundles;
+        for (Ptr<Packet> p = r.receiver->Receive (r.eid); p != NULL; p = r.receiver->Receive (r.eid))
+          {
+            bundles.push_back (p);
+            if (bundles.size () == r.batch)
+              {
+                r.callback (r.eid, bundles);
+                bundles.clear ();
+                delivered = true;
+              }
+          }
+        if (!bundles.empty ())
+          {
+            r.callback (r.eid, bundles);
+            delivered = true;
+          }
+      }
+    if (delivered)
+      {
+        m_nDeliveries++;
+        m_nIdleDrains = 0;
+      }
+    else
+      {
+        m_nIdleDrains++;
+      }
+    if (m_nIdleDrains < 2)
+      {
+        m_drain = Simulator::Schedule (m_rearm, &BundleDeliveryDispatcher::Drain, this);
+      }
+  }
+
+  std::vector<Registration> m_registrations;
+  std::set<uint32_t> m_nodes;
+  Time m_rearm;
+  EventId m_drain;
+  uint32_t m_nIdleDrains; // drains in a row that found no bundle
+  uint64_t m_nDrains;
+  uint64_t m_nDeliveries;
+};
+
+#endif /* BUNDLE_DELIVERY_H */
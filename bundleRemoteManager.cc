@@ -6,6 +6,7 @@
 #include "ns3/network-module.h"
 #include "ns3/bp-endpoint-id.h"
 #include "ns3/bundle-protocol.h"
+#include "ns3/bp-routing-protocol.h"
 #include "ns3/bp-static-routing-protocol.h"
 #include "ns3/bundle-protocol-helper.h"
 #include "ns3/bundle-protocol-container.h"
@@ -26,28 +27,1446 @@
 #include <iostream>
 #include <fstream>
 #include <numeric>
+#include <ctime>
+#include <unordered_map>
+#include <algorithm>
+#include <set>
+#include <deque>
+#include <queue>
+#include <limits>
+#include <cstddef>
+#include <cctype>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <cstdlib>
+#include "allocation-stats.h"
+#include "bundle-delivery.h"
 using namespace ns3;
 NS_LOG_COMPONENT_DEFINE ("BundleProtocolSimpleExample");
+/**
+ * Custody store spilling bundles to a memory-mapped, append-only log.
+ *
+ * Every bundle is appended to the log with its destination and expiry,
+ * so the index can be rebuilt when the log is reopened.  The index by
+ * destination and by expiry stays in memory, with every destination
+ * interned once to a small id; the payloads of the most
+ * recent bundles, up to a byte budget, are also kept as packets, and
+ * the others are read back from the file on demand.  Every few MiB of
+ * log written, the pages behind the write position are flushed and
+ * dropped from the mapping, so memory stays bounded by the index, the
+ * hot budget and that window.  Log space is not reclaimed.
+ */
+class BundleStore
+{
+public:
+  BundleStore ();
+  ~BundleStore ();
+
+  // maps fileName, recovering the bundles not yet taken
+  bool Open (std::string fileName, uint64_t segmentSize = 64 << 20);
+  void SetHotBytes (uint64_t bytes);
+
+  bool Store (const std::string &destination, Ptr<Packet> bundle, Time expiry);
+  // the oldest unexpired bundle for destination, or 0
+  Ptr<Packet> Take (const std::string &destination);
+  // drops the bundles expired at now; returns how many
+  uint32_t Expire (Time now);
+
+  uint64_t GetNBundles () const;
+  uint64_t GetNHot () const;
+  uint64_t GetLogBytes () const;
+
+private:
+  // precedes every bundle in the log
+  struct RecordHeader
+  {
+    uint32_t magic;
+    uint32_t taken;
+    uint32_t size;
+    uint32_t destinationSize;
+    int64_t expiry; // ns
+  };
+
+  struct Record
+  {
+    uint64_t offset; // of the RecordHeader
+    uint32_t size;
+    int64_t expiry;
+  };
+
+  // (expiry, bundle id), unique as the ids are
+  typedef std::pair<int64_t, uint64_t> ExpiryKey;
+
+  bool MapSegment ();
+  // record length, padded to keep the headers aligned
+  static uint64_t Length (const RecordHeader &header);
+  uint8_t * At (uint64_t offset);
+  uint32_t Intern (const std::string &destination);
+  void Index (uint64_t id, uint32_t destination, const Record &record);
+  void Remove (uint32_t destination, uint64_t id);
+  // counts log bytes written, releasing them past the window
+  void Touch (uint64_t bytes);
+  // writes back and unmaps the pages of the log before end
+  void Release (uint64_t end);
+
+  static const uint32_t MAGIC = 0x424e444c;
+  static const uint64_t RELEASE_BYTES = 4 << 20;
+
+  int m_fd;
+  uint64_t m_segmentSize;
+  std::vector<uint8_t *> m_segments;
+  uint64_t m_end;
+  uint64_t m_nextId;
+  uint64_t m_nBundles;
+  uint64_t m_pageSize;
+  uint64_t m_touchedBytes;
+  std::vector<uint8_t> m_readBuffer;
+
+  std::unordered_map<std::string, uint32_t> m_destinationIds;
+  std::vector<std::string> m_destinations;
+  // destination id -> bundles in arrival order
+  std::vector<std::map<uint64_t, Record> > m_index;
+  // -> destination id
+  std::map<ExpiryKey, uint32_t> m_expiry;
+
+  std::map<uint64_t, Ptr<Packet> > m_hot;
+  // in storage order; ids taken since are skipped when evicting
+  std::deque<uint64_t> m_hotOrder;
+  uint64_t m_hotBytes;
+  uint64_t m_maxHotBytes;
+};
+
+BundleStore::BundleStore ()
+  : m_fd (-1),
+    m_segmentSize (0),
+    m_end (0),
+    m_nextId (0),
+    m_nBundles (0),
+    m_pageSize (sysconf (_SC_PAGESIZE)),
+    m_touchedBytes (0),
+    m_hotBytes (0),
+    m_maxHotBytes (16 << 20)
+{
+}
+
+BundleStore::~BundleStore ()
+{
+  for (uint32_t i = 0; i < m_segments.size (); i++)
+    {
+      munmap (m_segments[i], m_segmentSize);
+    }
+  if (m_fd >= 0)
+    {
+      close (m_fd);
+    }
+}
+
+bool
+BundleStore::MapSegment ()
+{
+  uint64_t size = (m_segments.size () + 1) * m_segmentSize;
+  struct stat st;
+  if (fstat (m_fd, &st) != 0)
+    {
+      return false;
+    }
+  if ((uint64_t) st.st_size < size && ftruncate (m_fd, size) != 0)
+    {
+      return false;
+    }
+  void *map = mmap (NULL, m_segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd,
+                    m_segments.size () * m_segmentSize);
+  if (map == MAP_FAILED)
+    {
+      return false;
+    }
+  m_segments.push_back (static_cast<uint8_t *> (map));
+  return true;
+}
+
+uint64_t
+BundleStore::Length (const RecordHeader &header)
+{
+  return (sizeof (header) + header.destinationSize + header.size + 7) & ~7ULL;
+}
+
+uint8_t *
+BundleStore::At (uint64_t offset)
+{
+  return m_segments[offset / m_segmentSize] + offset % m_segmentSize;
+}
+
+void
+BundleStore::Touch (uint64_t bytes)
+{
+  m_touchedBytes += bytes;
+  if (m_touchedBytes >= RELEASE_BYTES)
+    {
+      Release (m_end & ~(m_pageSize - 1));
+      m_touchedBytes = 0;
+    }
+}
+
+void
+BundleStore::Release (uint64_t end)
+{
+  for (uint64_t from = 0; from < end; from += m_segmentSize)
+    {
+      uint64_t length = std::min (m_segmentSize, end - from);
+      msync (At (from), length, MS_ASYNC);
+      madvise (At (from), length, MADV_DONTNEED);
+    }
+}
+
+bool
+BundleStore::Open (std::string fileName, uint64_t segmentSize)
+{
+  // segments are released page by page
+  m_segmentSize = (segmentSize + m_pageSize - 1) & ~(m_pageSize - 1);
+  m_fd = open (fileName.c_str (), O_RDWR | O_CREAT, 0644);
+  if (m_fd < 0)
+    {
+      return false;
+    }
+  struct stat st;
+  if (fstat (m_fd, &st) != 0)
+    {
+      return false;
+    }
+  do
+    {
+      if (!MapSegment ())
+        {
+          return false;
+        }
+    }
+  while ((uint64_t) st.st_size > m_segments.size () * m_segmentSize);
+
+  // recover: records are packed within each segment, zeros follow
+  m_end = 0;
+  while (m_end < m_segments.size () * m_segmentSize)
+    {
+      RecordHeader header;
+      uint64_t room = m_segmentSize - m_end % m_segmentSize;
+      if (room >= sizeof (header))
+        {
+          memcpy (&header, At (m_end), sizeof (header));
+        }
+      if (room >= sizeof (header) && header.magic == MAGIC
+          && (uint64_t) header.size + header.destinationSize > room - sizeof (header))
+        {
+          // torn by a crash while appending: it was the last record, and
+          // the next Store overwrites it, with zeros after
+          NS_LOG_WARN ("Dropping a torn record at " << m_end << " of " << fileName);
+          memset (At (m_end), 0, room);
+          break;
+        }
+      if (room < sizeof (header) || header.magic != MAGIC)
+        {
+          // end of this segment's records
+          uint64_t next = (m_end / m_segmentSize + 1) * m_segmentSize;
+          if (next >= m_segments.size () * m_segmentSize || *At (next) == 0)
+            {
+              break;
+            }
+          m_end = next;
+          continue;
+        }
+      if (!header.taken)
+        {
+          std::string destination (reinterpret_cast<char *> (At (m_end + sizeof (header))),
+                                   header.destinationSize);
+          Record record;
+          record.offset = m_end;
+          record.size = header.size;
+          record.expiry = header.expiry;
+          Index (m_nextId, Intern (destination), record);
+        }
+      m_nextId++;
+      m_end += Length (header);
+    }
+  Release (m_end & ~(m_pageSize - 1));
+  return true;
+}
+
+void
+BundleStore::SetHotBytes (uint64_t bytes)
+{
+  m_maxHotBytes = bytes;
+}
+
+uint32_t
+BundleStore::Intern (const std::string &destination)
+{
+  std::pair<std::unordered_map<std::string, uint32_t>::iterator, bool> interned =
+    m_destinationIds.insert (std::make_pair (destination, (uint32_t) m_destinations.size ()));
+  if (interned.second)
+    {
+      m_destinations.push_back (destination);
+      m_index.resize (m_destinations.size ());
+    }
+  return interned.first->second;
+}
+
+void
+BundleStore::Index (uint64_t id, uint32_t destination, const Record &record)
+{
+  m_index[destination][id] = record;
+  m_expiry[ExpiryKey (record.expiry, id)] = destination;
+  m_nBundles++;
+}
+
+void
+BundleStore::Remove (uint32_t destination, uint64_t id)
+{
+  std::map<uint64_t, Record> &queue = m_index[destination];
+  std::map<uint64_t, Record>::iterator it = queue.find (id);
+  if (it == queue.end ())
+    {
+      return;
+    }
+  // persist the removal, so a reopened store does not resurrect it;
+  // written through the file, so cold pages are not mapped back in
+  uint32_t taken = 1;
+  if (pwrite (m_fd, &taken, sizeof (taken), it->second.offset + offsetof (RecordHeader, taken))
+      != (ssize_t) sizeof (taken))
+    {
+      NS_LOG_ERROR ("Unable to mark bundle " << id << " taken");
+    }
+  m_expiry.erase (ExpiryKey (it->second.expiry, id));
+  queue.erase (it);
+  std::map<uint64_t, Ptr<Packet> >::iterator hot = m_hot.find (id);
+  if (hot != m_hot.end ())
+    {
+      m_hotBytes -= hot->second->GetSize ();
+      m_hot.erase (hot);
+      // drop the taken ids once they outnumber the hot ones
+      if (m_hotOrder.size () > 2 * m_hot.size () + 64)
+        {
+          std::deque<uint64_t> order;
+          for (uint32_t i = 0; i < m_hotOrder.size (); i++)
+            {
+              if (m_hot.count (m_hotOrder[i]) > 0)
+                {
+                  order.push_back (m_hotOrder[i]);
+                }
+            }
+          m_hotOrder.swap (order);
+        }
+    }
+  m_nBundles--;
+}
+
+bool
+BundleStore::Store (const std::string &destination, Ptr<Packet> bundle, Time expiry)
+{
+  RecordHeader header;
+  header.magic = MAGIC;
+  header.taken = 0;
+  header.size = bundle->GetSize ();
+  header.destinationSize = destination.size ();
+  header.expiry = expiry.GetNanoSeconds ();
+  uint64_t length = Length (header);
+  if (length > m_segmentSize)
+    {
+      NS_LOG_ERROR ("Bundle of " << header.size << " bytes exceeds the store segment");
+      return false;
+    }
+  if (m_end % m_segmentSize + length > m_segmentSize)
+    {
+      m_end = (m_end / m_segmentSize + 1) * m_segmentSize;
+    }
+  while (m_end + length > m_segments.size () * m_segmentSize)
+    {
+      if (!MapSegment ())
+        {
+          return false;
+        }
+    }
+  // the header goes last, so a record is only found once complete
+  uint8_t *p = At (m_end);
+  memcpy (p + sizeof (header), destination.data (), destination.size ());
+  bundle->CopyData (p + sizeof (header) + destination.size (), header.size);
+  memcpy (p, &header, sizeof (header));
+
+  Record record;
+  record.offset = m_end;
+  record.size = header.size;
+  record.expiry = header.expiry;
+  uint64_t id = m_nextId++;
+  Index (id, Intern (destination), record);
+  m_end += length;
+  Touch (length);
+
+  // the newest bundles stay in memory, within the budget
+  m_hot[id] = bundle;
+  m_hotOrder.push_back (id);
+  m_hotBytes += header.size;
+  while (m_hotBytes > m_maxHotBytes && !m_hotOrder.empty ())
+    {
+      std::map<uint64_t, Ptr<Packet> >::iterator hot = m_hot.find (m_hotOrder.front ());
+      if (hot != m_hot.end ())
+        {
+          m_hotBytes -= hot->second->GetSize ();
+          m_hot.erase (hot);
+        }
+      m_hotOrder.pop_front ();
+    }
+  return true;
+}
+
+Ptr<Packet>
+BundleStore::Take (const std::string &destination)
+{
+  std::unordered_map<std::string, uint32_t>::const_iterator interned = m_destinationIds.find (destination);
+  if (interned == m_destinationIds.end () || m_index[interned->second].empty ())
+    {
+      return 0;
+    }
+  uint64_t id = m_index[interned->second].begin ()->first;
+  Record record = m_index[interned->second].begin ()->second;
+  std::map<uint64_t, Ptr<Packet> >::iterator hot = m_hot.find (id);
+  Ptr<Packet> bundle;
+  if (hot != m_hot.end ())
+    {
+      bundle = hot->second;
+    }
+  else
+    {
+      // read through the file: faulting the mapping in would map the
+      // neighbouring pages too, and keep them until the next Release
+      m_readBuffer.resize (record.size);
+      if (pread (m_fd, m_readBuffer.data (), record.size,
+                 record.offset + sizeof (RecordHeader) + destination.size ()) != (ssize_t) record.size)
+        {
+          NS_LOG_ERROR ("Unable to read bundle " << id << " back");
+          return 0;
+        }
+      bundle = Create<Packet> (m_readBuffer.data (), record.size);
+    }
+  Remove (interned->second, id);
+  return bundle;
+}
+
+uint32_t
+BundleStore::Expire (Time now)
+{
+  uint32_t expired = 0;
+  while (!m_expiry.empty () && m_expiry.begin ()->first.first <= now.GetNanoSeconds ())
+    {
+      // Remove erases the entry
+      uint64_t id = m_expiry.begin ()->first.second;
+      Remove (m_expiry.begin ()->second, id);
+      expired++;
+    }
+  return expired;
+}
+
+uint64_t
+BundleStore::GetNBundles () const
+{
+  return m_nBundles;
+}
+
+uint64_t
+BundleStore::GetNHot () const
+{
+  return m_hot.size ();
+}
+
+uint64_t
+BundleStore::GetLogBytes () const
+{
+  return m_end;
+}
+
+/**
+ * Bundle routing table indexed for large endpoint counts.
+ *
+ * Endpoint URIs are interned once; the routes of exact endpoints are
+ * a dense vector indexed by the interned id, found with one hash of
+ * the URI.  An endpoint whose SSP ends in '*' is a wildcard matching
+ * every URI with that prefix; the longest matching prefix wins, and
+ * exact routes win over wildcards.  Routes can be bulk-loaded from a
+ * file of "scheme:ssp address port" lines.
+ */
+class BpIndexedRoutingProtocol : public BpRoutingProtocol
+{
+public:
+  static TypeId GetTypeId (void)
+  {
+    static TypeId tid = TypeId ("ns3::BpIndexedRoutingProtocol")
+      .SetParent<BpRoutingProtocol> ()
+      .AddConstructor<BpIndexedRoutingProtocol> ();
+    return tid;
+  }
+
+  BpIndexedRoutingProtocol ()
+  {
+  }
+
+  virtual void SetBundleProtocol (Ptr<BundleProtocol> bundleProtocol)
+  {
+    m_bp = bundleProtocol;
+  }
+
+  virtual int AddRoute (BpEndpointId eid, InetSocketAddress address)
+  {
+    return AddRoute (eid.Uri (), address);
+  }
+
+  virtual InetSocketAddress GetRoute (BpEndpointId eid)
+  {
+    InetSocketAddress address (Ipv4Address::GetAny (), 0);
+    if (!Lookup (eid.Uri (), address))
+      {
+        NS_LOG_WARN ("No route to " << eid.Uri ());
+      }
+    return address;
+  }
+
+  // uri is "scheme:ssp"; an ssp ending in '*' adds a wildcard route
+  int AddRoute (const std::string &uri, InetSocketAddress address)
+  {
+    if (!uri.empty () && uri[uri.size () - 1] == '*')
+      {
+        std::string prefix = uri.substr (0, uri.size () - 1);
+        m_prefixes.erase (prefix);
+        m_prefixes.insert (std::make_pair (prefix, address));
+        m_prefixLengths.insert (prefix.size ());
+        return 0;
+      }
+    uint32_t id = Intern (uri);
+    if (id >= m_routes.size ())
+      {
+        m_routes.resize (id + 1, InetSocketAddress (Ipv4Address::GetAny (), 0));
+        m_hasRoute.resize (id + 1, false);
+      }
+    m_routes[id] = address;
+    m_hasRoute[id] = true;
+    return 0;
+  }
+
+  bool Lookup (const std::string &uri, InetSocketAddress &address) const
+  {
+    UriIds::const_iterator it = m_ids.find (uri);
+    if (it != m_ids.end () && m_hasRoute[it->second])
+      {
+        address = m_routes[it->second];
+        return true;
+      }
+    for (std::set<uint32_t>::const_reverse_iterator length = m_prefixLengths.rbegin ();
+         length != m_prefixLengths.rend (); ++length)
+      {
+        if (*length > uri.size ())
+          {
+            continue;
+          }
+        Prefixes::const_iterator prefix = m_prefixes.find (uri.substr (0, *length));
+        if (prefix != m_prefixes.end ())
+          {
+            address = prefix->second;
+            return true;
+          }
+      }
+    return false;
+  }
+
+  // returns the number of routes loaded, or -1 if the file cannot be read
+  int LoadFile (std::string fileName)
+  {
+    std::ifstream in (fileName.c_str ());
+    if (!in)
+      {
+        return -1;
+      }
+    int loaded = 0;
+    uint32_t lineNumber = 0;
+    std::string line;
+    while (std::getline (in, line))
+      {
+        lineNumber++;
+        std::istringstream fields (line);
+        std::string uri;
+        std::string ip;
+        uint32_t port;
+        std::string extra;
+        if (line.empty () || line[0] == '#')
+          {
+            continue;
+          }
+        Ipv4Address address;
+        if (!(fields >> uri >> ip >> port) || fields >> extra || port > 65535 || !ParseAddress (ip, address))
+          {
+            NS_LOG_WARN (fileName << ":" << lineNumber << ": skipping malformed route \"" << line << "\"");
+            continue;
+          }
+        AddRoute (uri, InetSocketAddress (address, port));
+        loaded++;
+      }
+    return loaded;
+  }
+
+  // strict dotted quad: Ipv4Address (const char *) accepts anything
+  static bool ParseAddress (const std::string &text, Ipv4Address &address)
+  {
+    uint32_t value = 0;
+    uint32_t octets = 0;
+    uint32_t i = 0;
+    while (octets < 4)
+      {
+        uint32_t octet = 0;
+        uint32_t digits = 0;
+        while (i < text.size () && isdigit (text[i]) && digits < 3)
+          {
+            octet = octet * 10 + (text[i++] - '0');
+            digits++;
+          }
+        if (digits == 0 || octet > 255)
+          {
+            return false;
+          }
+        value = (value << 8) | octet;
+        if (++octets < 4 && (i >= text.size () || text[i++] != '.'))
+          {
+            return false;
+          }
+      }
+    if (i != text.size ())
+      {
+        return false;
+      }
+    address = Ipv4Address (value);
+    return true;
+  }
+
+  uint32_t GetNRoutes () const
+  {
+    return std::count (m_hasRoute.begin (), m_hasRoute.end (), true) + m_prefixes.size ();
+  }
+
+private:
+  typedef std::unordered_map<std::string, uint32_t> UriIds;
+  typedef std::unordered_map<std::string, InetSocketAddress> Prefixes;
+
+  uint32_t Intern (const std::string &uri)
+  {
+    std::pair<UriIds::iterator, bool> inserted = m_ids.insert (std::make_pair (uri, (uint32_t) m_ids.size ()));
+    return inserted.first->second;
+  }
+
+  Ptr<BundleProtocol> m_bp;
+  UriIds m_ids;
+  std::vector<InetSocketAddress> m_routes;
+  std::vector<bool> m_hasRoute;
+  Prefixes m_prefixes;
+  std::set<uint32_t> m_prefixLengths;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (BpIndexedRoutingProtocol);
+
+// Times route insertion and lookup of nRoutes endpoints in the static
+// and the indexed routing protocols; small tables are repeated until
+// about a million operations, for the millisecond clock
+void RunRouteBenchmark (uint32_t nRoutes)
+{
+  uint32_t repeats = std::max<uint32_t> (1, 1000000 / nRoutes);
+  std::vector<BpEndpointId> eids;
+  std::vector<InetSocketAddress> addresses;
+  for (uint32_t n = 0; n < nRoutes; n++)
+    {
+      std::ostringstream ssp;
+      ssp << "node" << n;
+      eids.push_back (BpEndpointId ("dtn", ssp.str ()));
+      addresses.push_back (InetSocketAddress (Ipv4Address (0x0a000000 + n), 9));
+    }
+  // lookups in a scattered order
+  std::vector<uint32_t> order (nRoutes);
+  for (uint32_t n = 0; n < nRoutes; n++)
+    {
+      order[n] = (uint64_t) n * 2654435761u % nRoutes;
+    }
+
+  std::cout << "Protocol\tRoutes\tInsertNs\tLookupNs" << std::endl;
+  for (uint32_t indexed = 0; indexed < 2; indexed++)
+    {
+      Ptr<BpRoutingProtocol> route;
+      SystemWallClockMs clock;
+      clock.Start ();
+      for (uint32_t r = 0; r < repeats; r++)
+        {
+          if (indexed)
+            {
+              route = CreateObject<BpIndexedRoutingProtocol> ();
+            }
+          else
+            {
+              route = CreateObject<BpStaticRoutingProtocol> ();
+            }
+          for (uint32_t n = 0; n < nRoutes; n++)
+            {
+              route->AddRoute (eids[n], addresses[n]);
+            }
+        }
+      double insertMs = clock.End ();
+      clock.Start ();
+      uint32_t port = 0;
+      for (uint32_t r = 0; r < repeats; r++)
+        {
+          port = 0;
+          for (uint32_t n = 0; n < nRoutes; n++)
+            {
+              port += route->GetRoute (eids[order[n]]).GetPort ();
+            }
+        }
+      double lookupMs = clock.End ();
+      double nOperations = (double) nRoutes * repeats;
+      std::cout << (indexed ? "indexed" : "static") << "\t" << nRoutes << "\t"
+                << insertMs * 1e6 / nOperations << "\t" << lookupMs * 1e6 / nOperations
+                << (port == 9 * nRoutes ? "" : "\t(wrong routes)") << std::endl;
+    }
+}
+
+/**
+ * Contact plan: the windows in which two nodes can reach each other.
+ *
+ * Contacts are loaded from a plan file of ION-style lines
+ * "a contact <start s> <end s> <from> <to>", or predicted from the
+ * mobility models by extrapolating each node's current velocity, which
+ * is exact for constant-position and constant-velocity models.  The
+ * prediction is redone from the current positions and velocities
+ * whenever a node changes course.
+ */
+class ContactPlan
+{
+public:
+  struct Contact
+  {
+    uint32_t from;
+    uint32_t to;
+    double start; // s
+    double end;   // s
+    bool predicted;
+  };
+
+  ContactPlan ()
+    : m_nNodes (0),
+      m_version (0),
+      m_range (0),
+      m_predictEnd (0),
+      m_step (0),
+      m_nPredictions (0)
+  {
+  }
+
+  void AddContact (uint32_t from, uint32_t to, double start, double end, bool predicted = false)
+  {
+    Contact c;
+    c.from = from;
+    c.to = to;
+    c.start = start;
+    c.end = end;
+    c.predicted = predicted;
+    m_contacts.push_back (c);
+    m_nNodes = std::max (m_nNodes, std::max (from, to) + 1);
+    if (m_outgoing.size () < m_nNodes)
+      {
+        m_outgoing.resize (m_nNodes);
+      }
+    m_outgoing[from].push_back (m_contacts.size () - 1);
+    m_version++;
+  }
+
+  // returns the number of contacts loaded, or -1 if the file cannot be read
+  int LoadFile (std::string fileName)
+  {
+    std::ifstream in (fileName.c_str ());
+    if (!in)
+      {
+        return -1;
+      }
+    int loaded = 0;
+    std::string line;
+    while (std::getline (in, line))
+      {
+        std::istringstream fields (line);
+        std::string command;
+        std::string kind;
+        double start;
+        double end;
+        uint32_t from;
+        uint32_t to;
+        if ((fields >> command >> kind >> start >> end >> from >> to) && command == "a" && kind == "contact")
+          {
+            AddContact (from, to, start, end);
+            loaded++;
+          }
+      }
+    return loaded;
+  }
+
+  // samples every pair within range from now to now + horizon, and
+  // again from the time of every course change to the same end
+  void Predict (NodeContainer nodes, double range, double horizon, double step)
+  {
+    double now = Simulator::Now ().GetSeconds ();
+    if (m_nodes.GetN () == 0)
+      {
+        for (uint32_t i = 0; i < nodes.GetN (); i++)
+          {
+            nodes.Get (i)->GetObject<MobilityModel> ()->TraceConnectWithoutContext (
+              "CourseChange", MakeCallback (&ContactPlan::CourseChanged, this));
+          }
+      }
+    m_nodes = nodes;
+    m_range = range;
+    m_predictEnd = now + horizon;
+    m_step = step;
+    m_nPredictions++;
+    std::vector<Vector> positions;
+    std::vector<Vector> velocities;
+    for (uint32_t i = 0; i < nodes.GetN (); i++)
+      {
+        Ptr<MobilityModel> mobility = nodes.Get (i)->GetObject<MobilityModel> ();
+        positions.push_back (mobility->GetPosition ());
+        velocities.push_back (mobility->GetVelocity ());
+      }
+    for (uint32_t a = 0; a < nodes.GetN (); a++)
+      {
+        for (uint32_t b = a + 1; b < nodes.GetN (); b++)
+          {
+            double opened = -1;
+            for (double t = 0; t <= horizon; t += step)
+              {
+                double dx = positions[a].x + velocities[a].x * t - positions[b].x - velocities[b].x * t;
+                double dy = positions[a].y + velocities[a].y * t - positions[b].y - velocities[b].y * t;
+                double dz = positions[a].z + velocities[a].z * t - positions[b].z - velocities[b].z * t;
+                bool inRange = dx * dx + dy * dy + dz * dz <= range * range;
+                if (inRange && opened < 0)
+                  {
+                    opened = t;
+                  }
+                else if (!inRange && opened >= 0)
+                  {
+                    AddContact (a, b, now + opened, now + t, true);
+                    AddContact (b, a, now + opened, now + t, true);
+                    opened = -1;
+                  }
+              }
+            if (opened >= 0)
+              {
+                AddContact (a, b, now + opened, now + horizon, true);
+                AddContact (b, a, now + opened, now + horizon, true);
+              }
+          }
+      }
+  }
+
+  uint32_t GetNNodes () const
+  {
+    return m_nNodes;
+  }
+  uint32_t GetNContacts () const
+  {
+    return m_contacts.size ();
+  }
+  // changes whenever a contact is added
+  uint64_t GetVersion () const
+  {
+    return m_version;
+  }
+  const Contact & GetContact (uint32_t index) const
+  {
+    return m_contacts[index];
+  }
+  const std::vector<uint32_t> & GetOutgoing (uint32_t node) const
+  {
+    static const std::vector<uint32_t> none;
+    return node < m_outgoing.size () ? m_outgoing[node] : none;
+  }
+
+  // the initial prediction and every refresh
+  uint64_t GetNPredictions () const
+  {
+    return m_nPredictions;
+  }
+
+private:
+  void CourseChanged (Ptr<const MobilityModel> model)
+  {
+    // nodes often change course together; predict once for all of them
+    if (!m_refresh.IsRunning ())
+      {
+        m_refresh = Simulator::ScheduleNow (&ContactPlan::Refresh, this);
+      }
+  }
+
+  // replaces the predicted contacts by a prediction from now
+  void Refresh ()
+  {
+    double now = Simulator::Now ().GetSeconds ();
+    if (now >= m_predictEnd)
+      {
+        return;
+      }
+    std::vector<Contact> contacts;
+    contacts.swap (m_contacts);
+    m_outgoing.clear ();
+    m_nNodes = 0;
+    for (uint32_t i = 0; i < contacts.size (); i++)
+      {
+        if (!contacts[i].predicted)
+          {
+            AddContact (contacts[i].from, contacts[i].to, contacts[i].start, contacts[i].end);
+          }
+      }
+    // the routers recompute even if nothing is predicted
+    m_version++;
+    Predict (m_nodes, m_range, m_predictEnd - now, m_step);
+  }
+
+  std::vector<Contact> m_contacts;
+  std::vector<std::vector<uint32_t> > m_outgoing;
+  uint32_t m_nNodes;
+  uint64_t m_version;
+  // the prediction, kept for Refresh
+  NodeContainer m_nodes;
+  double m_range;
+  double m_predictEnd; // s
+  double m_step;       // s
+  EventId m_refresh;
+  uint64_t m_nPredictions;
+};
+
+/**
+ * Earliest-arrival routes over a contact plan.
+ *
+ * One Dijkstra from the source gives the earliest arrival at every
+ * node when leaving at a given time: a contact from u to v is usable
+ * if u is reached before it ends, and v is then reached at the later
+ * of that time and the contact start.  The resulting tree is cached and
+ * reused for later departures until the plan changes or a contact the
+ * tree uses closes; a later departure can never arrive earlier, so the
+ * tree's paths remain optimal until then.
+ */
+class ContactGraphRouter
+{
+public:
+  ContactGraphRouter ()
+    : m_plan (NULL),
+      m_source (0),
+      m_version (0),
+      m_departure (0),
+      m_validUntil (-1),
+      m_nComputations (0),
+      m_computeMs (0)
+  {
+  }
+
+  void SetPlan (const ContactPlan *plan, uint32_t source)
+  {
+    m_plan = plan;
+    m_source = source;
+    m_validUntil = -1;
+  }
+
+  // next hop from the source towards destination when leaving at now;
+  // false if the destination cannot be reached.  The contact to the
+  // next hop may open later: see GetDeparture.
+  bool GetNextHop (uint32_t destination, double now, uint32_t &nextHop, double &arrival)
+  {
+    if (m_validUntil < now || m_version != m_plan->GetVersion () || m_departure > now)
+      {
+        Compute (now);
+      }
+    if (destination >= m_arrival.size () || m_arrival[destination] == std::numeric_limits<double>::infinity ()
+        || destination == m_source)
+      {
+        return false;
+      }
+    nextHop = m_firstHop[destination];
+    // the tree may have been computed for an earlier departure
+    arrival = std::max (now, m_arrival[destination]);
+    return true;
+  }
+
+  // when a bundle leaving at now can go to the next hop towards a
+  // destination GetNextHop reached: now, or the start of the contact
+  double GetDeparture (uint32_t destination, double now) const
+  {
+    return std::max (now, m_plan->GetContact (m_firstContact[destination]).start);
+  }
+
+  uint64_t GetNComputations () const
+  {
+    return m_nComputations;
+  }
+  double GetComputeMs () const
+  {
+    return m_computeMs;
+  }
+
+private:
+  void Compute (double now)
+  {
+    // whole milliseconds: only large plans add up here
+    SystemWallClockMs clock;
+    clock.Start ();
+    uint32_t n = m_plan->GetNNodes ();
+    m_arrival.assign (n, std::numeric_limits<double>::infinity ());
+    m_firstHop.assign (n, 0);
+    m_firstContact.assign (n, -1);
+    m_via.assign (n, -1);
+    if (m_source < n)
+      {
+        typedef std::pair<double, uint32_t> Entry;
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > queue;
+        m_arrival[m_source] = now;
+        queue.push (Entry (now, m_source));
+        while (!queue.empty ())
+          {
+            Entry e = queue.top ();
+            queue.pop ();
+            if (e.first > m_arrival[e.second])
+              {
+                continue;
+              }
+            const std::vector<uint32_t> &outgoing = m_plan->GetOutgoing (e.second);
+            for (uint32_t i = 0; i < outgoing.size (); i++)
+              {
+                const ContactPlan::Contact &c = m_plan->GetContact (outgoing[i]);
+                if (c.end < e.first)
+                  {
+                    continue;
+                  }
+                double arrival = std::max (e.first, c.start);
+                if (arrival < m_arrival[c.to])
+                  {
+                    m_arrival[c.to] = arrival;
+                    m_firstHop[c.to] = e.second == m_source ? c.to : m_firstHop[e.second];
+                    m_firstContact[c.to] = e.second == m_source ? outgoing[i] : m_firstContact[e.second];
+                    m_via[c.to] = outgoing[i];
+                    queue.push (Entry (arrival, c.to));
+                  }
+              }
+          }
+      }
+    // valid until a contact on the tree closes
+    m_validUntil = std::numeric_limits<double>::infinity ();
+    for (uint32_t v = 0; v < n; v++)
+      {
+        if (m_via[v] >= 0)
+          {
+            m_validUntil = std::min (m_validUntil, m_plan->GetContact (m_via[v]).end);
+          }
+      }
+    m_departure = now;
+    m_version = m_plan->GetVersion ();
+    m_nComputations++;
+    m_computeMs += clock.End ();
+  }
+
+  const ContactPlan *m_plan;
+  uint32_t m_source;
+  uint64_t m_version;
+  double m_departure;
+  double m_validUntil;
+  std::vector<double> m_arrival;
+  std::vector<uint32_t> m_firstHop;
+  std::vector<int64_t> m_firstContact;
+  std::vector<int64_t> m_via;
+  uint64_t m_nComputations;
+  double m_computeMs;
+};
+
+/**
+ * Bundle routing over predicted contacts: a bundle for an endpoint is
+ * handed to the first hop of the earliest-arrival path to the
+ * endpoint's node.  BundleProtocol sends a routed bundle at once, so a
+ * sender holds the bundle until GetDeparture, when the first contact
+ * of the path opens.  Only an endpoint without a path falls back to
+ * the static route.
+ */
+class BpContactGraphRoutingProtocol : public BpRoutingProtocol
+{
+public:
+  static TypeId GetTypeId (void)
+  {
+    static TypeId tid = TypeId ("ns3::BpContactGraphRoutingProtocol")
+      .SetParent<BpRoutingProtocol> ()
+      .AddConstructor<BpContactGraphRoutingProtocol> ();
+    return tid;
+  }
+
+  BpContactGraphRoutingProtocol ()
+    : m_local (0)
+  {
+  }
+
+  void SetContactPlan (const ContactPlan *plan, uint32_t localNode)
+  {
+    m_local = localNode;
+    m_router.SetPlan (plan, localNode);
+  }
+
+  // the plan node of an endpoint and the address reaching each node
+  void AddEndpoint (BpEndpointId eid, uint32_t node)
+  {
+    m_nodes[eid.Uri ()] = node;
+  }
+  void AddNodeAddress (uint32_t node, InetSocketAddress address)
+  {
+    m_addresses.erase (node);
+    m_addresses.insert (std::make_pair (node, address));
+  }
+
+  virtual void SetBundleProtocol (Ptr<BundleProtocol> bundleProtocol)
+  {
+    m_bp = bundleProtocol;
+  }
+
+  // a static route: the endpoint's node is reached at address
+  virtual int AddRoute (BpEndpointId eid, InetSocketAddress address)
+  {
+    m_static.erase (eid.Uri ());
+    m_static.insert (std::make_pair (eid.Uri (), address));
+    return 0;
+  }
+
+  virtual InetSocketAddress GetRoute (BpEndpointId eid)
+  {
+    std::map<std::string, uint32_t>::const_iterator node = m_nodes.find (eid.Uri ());
+    uint32_t nextHop;
+    double arrival;
+    double now = Simulator::Now ().GetSeconds ();
+    if (node != m_nodes.end () && m_router.GetNextHop (node->second, now, nextHop, arrival))
+      {
+        std::map<uint32_t, InetSocketAddress>::const_iterator address = m_addresses.find (nextHop);
+        if (address != m_addresses.end ())
+          {
+            double departure = m_router.GetDeparture (node->second, now);
+            if (departure > now)
+              {
+                NS_LOG_WARN ("Bundle for " << eid.Uri () << " routed before its contact to node "
+                             << nextHop << " opens at " << departure << " s; hold it until GetDeparture");
+              }
+            NS_LOG_INFO ("Route to " << eid.Uri () << " via node " << nextHop << ", arrival " << arrival << " s");
+            return address->second;
+          }
+      }
+    std::map<std::string, InetSocketAddress>::const_iterator fallback = m_static.find (eid.Uri ());
+    if (fallback != m_static.end ())
+      {
+        return fallback->second;
+      }
+    NS_LOG_WARN ("No contact towards " << eid.Uri ());
+    return InetSocketAddress (Ipv4Address::GetAny (), 0);
+  }
+
+  // when a bundle for eid should be handed to BundleProtocol: the
+  // start of the first contact of its path, or now without a path
+  double GetDeparture (BpEndpointId eid)
+  {
+    double now = Simulator::Now ().GetSeconds ();
+    std::map<std::string, uint32_t>::const_iterator node = m_nodes.find (eid.Uri ());
+    uint32_t nextHop;
+    double arrival;
+    if (node != m_nodes.end () && m_router.GetNextHop (node->second, now, nextHop, arrival))
+      {
+        return m_router.GetDeparture (node->second, now);
+      }
+    return now;
+  }
+
+  const ContactGraphRouter & GetRouter () const
+  {
+    return m_router;
+  }
+
+private:
+  Ptr<BundleProtocol> m_bp;
+  uint32_t m_local;
+  ContactGraphRouter m_router;
+  std::map<std::string, uint32_t> m_nodes;
+  std::map<uint32_t, InetSocketAddress> m_addresses;
+  std::map<std::string, InetSocketAddress> m_static;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (BpContactGraphRoutingProtocol);
+
+static ContactPlan g_contactPlan;
+static Ptr<BpContactGraphRoutingProtocol> g_contactRouting;
+
+// with contact routing, holds the bundle until the first contact of
+// its path opens
+void SendInContact (Ptr<BundleProtocol> sender, Ptr<Packet> packet, BpEndpointId src, BpEndpointId dst)
+{
+  if (g_contactRouting != 0)
+    {
+      Time departure = Seconds (g_contactRouting->GetDeparture (dst));
+      if (departure > Simulator::Now ())
+        {
+          std::cout << Simulator::Now ().GetMilliSeconds () << " Hold a bundle until the contact at "
+                    << departure.GetMilliSeconds () << " ms" << std::endl;
+          // at least a step later, so rounding cannot hold it forever
+          Simulator::Schedule (std::max (departure - Simulator::Now (), NanoSeconds (1)),
+                               &SendInContact, sender, packet, src, dst);
+          return;
+        }
+    }
+  sender->Send (packet, src, dst);
+}
+
 void Send (Ptr<BundleProtocol> sender, uint32_t size, BpEndpointId src, BpEndpointId dst)
 {
   std::cout << Simulator::Now ().GetMilliSeconds () << " Send a PDU with size " << size << std::endl;
 
-  Ptr<Packet> packet = Create<Packet> (size);
-  sender->Send (packet, src, dst);
+  // latency counts from here, including a hold for the contact
+  g_pduSendTimes.push_back (Simulator::Now ());
+  SendInContact (sender, g_packetPool.Get (size), src, dst);
 }
 
-void Receive (Ptr<BundleProtocol> receiver, BpEndpointId eid)
+// Times cold route computations and cached lookups on random contact
+// plans of growing size
+void RunContactGraphBenchmark (uint32_t nNodes)
 {
+  std::cout << "Nodes\tContacts\tComputeMs\tLookupNs" << std::endl;
+  srand (1);
+  for (uint32_t perNode = 10; perNode <= 1000; perNode *= 10)
+    {
+      ContactPlan plan;
+      for (uint32_t c = 0; c < nNodes * perNode; c++)
+        {
+          uint32_t from = rand () % nNodes;
+          uint32_t to = (from + 1 + rand () % (nNodes - 1)) % nNodes;
+          double start = (rand () % 86400);
+          plan.AddContact (from, to, start, start + 60 + rand () % 600);
+        }
+      // SetPlan drops the computed routes, so each first lookup computes
+      const uint32_t nComputations = 10;
+      ContactGraphRouter router;
+      uint32_t nextHop;
+      double arrival;
+      SystemWallClockMs clock;
+      clock.Start ();
+      for (uint32_t r = 0; r < nComputations; r++)
+        {
+          router.SetPlan (&plan, 0);
+          router.GetNextHop (1, 0, nextHop, arrival);
+        }
+      double computeMs = (double) clock.End () / nComputations;
+      uint32_t repeats = std::max<uint32_t> (1, 1000000 / (nNodes - 1));
+      uint32_t reached = 0;
+      clock.Start ();
+      for (uint32_t r = 0; r < repeats; r++)
+        {
+          reached = 0;
+          for (uint32_t d = 1; d < nNodes; d++)
+            {
+              reached += router.GetNextHop (d, 0, nextHop, arrival);
+            }
+        }
+      double lookupMs = (double) clock.End () / repeats;
+      std::cout << nNodes << "\t" << plan.GetNContacts () << "\t" << computeMs << "\t"
+                << lookupMs * 1e6 / (nNodes - 1) << "\t(" << reached << " reachable, "
+                << router.GetNComputations () << " computations)" << std::endl;
+    }
+}
 
+static BundleStore g_store;
+static bool g_useStore = false;
+static Time g_bundleLifetime = Seconds (3600);
+
+static BundleDeliveryDispatcher g_dispatcher;
+
+void HandleBundle (BpEndpointId eid, Ptr<Packet> p)
+{
+  std::cout << Simulator::Now ().GetMilliSeconds () << " Receive bundle size " << p->GetSize () << std::endl;
+  if (g_useStore)
+    {
+      // held in custody; delivered, and accounted, by Deliver
+      g_store.Store (eid.Uri (), p, Simulator::Now () + g_bundleLifetime);
+      return;
+    }
+  AccountDelivery (p->GetSize ());
+  g_packetPool.Put (p);
+}
+
+void Receive (Ptr<BundleProtocol> receiver, BpEndpointId eid)
+{
+  g_nReceiveCalls++;
   Ptr<Packet> p = receiver->Receive (eid);
   while (p != NULL)
     {
-      std::cout << Simulator::Now ().GetMilliSeconds () << " Receive bundle size " << p->GetSize () << std::endl;
+      HandleBundle (eid, p);
       p = receiver->Receive (eid);
     }
 }
+
+void PollReceive (Ptr<BundleProtocol> receiver, BpEndpointId eid, Time interval)
+{
+  Receive (receiver, eid);
+  Simulator::Schedule (interval, &PollReceive, receiver, eid, interval);
+}
+
+void ReceiveBundles (BpEndpointId eid, const std::vector<Ptr<Packet> > &bundles)
+{
+  for (uint32_t i = 0; i < bundles.size (); i++)
+    {
+      HandleBundle (eid, bundles[i]);
+    }
+}
+
+void Deliver (BpEndpointId eid)
+{
+  std::cout << Simulator::Now ().GetMilliSeconds () << " Expired " << g_store.Expire (Simulator::Now ())
+            << " stored bundles" << std::endl;
+  Ptr<Packet> p = g_store.Take (eid.Uri ());
+  while (p != 0)
+    {
+      std::cout << Simulator::Now ().GetMilliSeconds () << " Deliver stored bundle size " << p->GetSize () << std::endl;
+      AccountDelivery (p->GetSize ());
+      g_packetPool.Put (p);
+      p = g_store.Take (eid.Uri ());
+    }
+}
+
+static long PeakRssKb ()
+{
+  struct rusage usage;
+  getrusage (RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+// resident file-backed pages: the store's mapping, and the binaries
+static long FileRssKb ()
+{
+  std::ifstream status ("/proc/self/status");
+  std::string line;
+  while (std::getline (status, line))
+    {
+      if (line.compare (0, 8, "RssFile:") == 0)
+        {
+          return atol (line.c_str () + 8);
+        }
+    }
+  return -1;
+}
+
+// Fills the store with a backlog spread over destinations, then drains it
+void RunStoreBenchmark (std::string fileName, uint32_t nBundles, uint32_t bundleSize, uint64_t hotBytes)
+{
+  unlink (fileName.c_str ());
+  BundleStore store;
+  if (!store.Open (fileName))
+    {
+      std::cerr << "Unable to open " << fileName << std::endl;
+      return;
+    }
+  store.SetHotBytes (hotBytes);
+  const uint32_t nDestinations = 100;
+  std::vector<std::string> destinations;
+  for (uint32_t i = 0; i < nDestinations; i++)
+    {
+      std::ostringstream eid;
+      eid << "dtn:node" << i;
+      destinations.push_back (eid.str ());
+    }
+
+  long rss = PeakRssKb ();
+  long fileRss = FileRssKb ();
+  SystemWallClockMs clock;
+  clock.Start ();
+  for (uint32_t i = 0; i < nBundles; i++)
+    {
+      store.Store (destinations[i % nDestinations], Create<Packet> (bundleSize), Seconds (3600));
+    }
+  int64_t storeMs = clock.End ();
+  std::cout << "Stored " << nBundles << " bundles (" << store.GetLogBytes () << " log bytes) in "
+            << storeMs << " ms, peak RSS +" << PeakRssKb () - rss << " KiB, "
+            << store.GetNHot () << " hot, mapped log resident +" << FileRssKb () - fileRss << " KiB"
+            << std::endl;
+
+  clock.Start ();
+  uint64_t taken = 0;
+  for (uint32_t i = 0; i < nDestinations; i++)
+    {
+      while (store.Take (destinations[i]) != 0)
+        {
+          taken++;
+        }
+    }
+  std::cout << "Took " << taken << " bundles in " << clock.End () << " ms, peak RSS +"
+            << PeakRssKb () - rss << " KiB, mapped log resident +" << FileRssKb () - fileRss << " KiB"
+            << std::endl;
+}
 int main(int argc, char *argv[])
 {
+    uint32_t nPdus = 1;
+    double sendInterval = 0.1;
+    double simTime = 1.0;
+    double receiveInterval = 0;
+    std::string delivery = "poll";
+    uint32_t batch = 1;
+    std::string routing = "static";
+    std::string routeFile = "";
+    uint32_t routeBenchmark = 0;
+    std::string contactPlan = "";
+    double contactRange = 50;
+    uint32_t contactBenchmark = 0;
+    std::string storeFile = "";
+    uint32_t storeBenchmark = 0;
+    uint32_t storeBundleSize = 400;
+    uint64_t hotBytes = 16 << 20;
+    uint32_t allocStats = 1;
+    bool packetPool = false;
+    CommandLine cmd;
+    cmd.AddValue ("allocStats", "0=off;1=count heap allocations during Run;2=also time malloc/free", allocStats);
+    cmd.AddValue ("packetPool", "Reuse the packets the bundle sinks are done with for sends", packetPool);
+    cmd.AddValue ("pduSize", "Size of the PDU sent (bytes)", g_pduSize);
+    cmd.AddValue ("nPdus", "Number of PDUs sent", nPdus);
+    cmd.AddValue ("sendInterval", "Time between two PDUs (s)", sendInterval);
+    cmd.AddValue ("simTime", "Simulated time (s)", simTime);
+    cmd.AddValue ("delivery", "poll: call Receive on a schedule; event: deliver on arrival", delivery);
+    cmd.AddValue ("receiveInterval", "Poll the receiver every interval (s), 0=once at 0.8 s", receiveInterval);
+    cmd.AddValue ("batch", "Bundles per delivery callback (delivery=event)", batch);
+    cmd.AddValue ("routing", "Bundle routing: static, indexed or contact", routing);
+    cmd.AddValue ("routeFile", "Load indexed routes from this file (scheme:ssp address port per line)", routeFile);
+    cmd.AddValue ("routeBenchmark", "Time inserting and looking up this many routes, then exit", routeBenchmark);
+    cmd.AddValue ("contactPlan", "Load contacts from this file (a contact start end from to), else predict them", contactPlan);
+    cmd.AddValue ("contactRange", "Range within which predicted nodes are in contact (m)", contactRange);
+    cmd.AddValue ("contactBenchmark", "Time contact graph routing over this many nodes, then exit", contactBenchmark);
+    cmd.AddValue ("storeFile", "Keep received bundles in custody in this log until delivered", storeFile);
+    cmd.AddValue ("hotBytes", "Bundle bytes the store keeps in memory", hotBytes);
+    cmd.AddValue ("storeBenchmark", "Store and drain this many bundles, then exit", storeBenchmark);
+    cmd.AddValue ("storeBundleSize", "Bundle size of the store benchmark (bytes)", storeBundleSize);
+    cmd.Parse (argc, argv);
+    g_packetPool.SetEnabled (packetPool);
+
+    if (routeBenchmark > 0)
+      {
+        RunRouteBenchmark (routeBenchmark);
+        return 0;
+      }
+    if (contactBenchmark > 1)
+      {
+        RunContactGraphBenchmark (contactBenchmark);
+        return 0;
+      }
+    if (storeBenchmark > 0)
+      {
+        RunStoreBenchmark (storeFile.empty () ? "bundle-store.log" : storeFile, storeBenchmark, storeBundleSize, hotBytes);
+        return 0;
+      }
+    if (!storeFile.empty ())
+      {
+        g_useStore = g_store.Open (storeFile);
+        g_store.SetHotBytes (hotBytes);
+      }
+
     // // STDMA init
     // stdma::StdmaHelper stdma;
     // stdma.SetStandard(WIFI_PHY_STANDARD_80211p_CCH);
@@ -131,8 +1550,44 @@ int main(int argc, char *argv[])
     BpEndpointId eidSender ("dtn", "node0");
     BpEndpointId eidRecv ("dtn", "node1");
 
-    // set bundle static routing
-    Ptr<BpStaticRoutingProtocol> route = CreateObject<BpStaticRoutingProtocol> ();
+    // set bundle routing
+    Ptr<BpRoutingProtocol> route;
+    if (routing == "indexed")
+      {
+        Ptr<BpIndexedRoutingProtocol> indexed = CreateObject<BpIndexedRoutingProtocol> ();
+        if (!routeFile.empty ())
+          {
+            std::cout << "Loaded " << indexed->LoadFile (routeFile) << " routes from " << routeFile << std::endl;
+          }
+        route = indexed;
+      }
+    else if (routing == "contact")
+      {
+        // plan nodes are the wifiNodes indices; routes are computed from
+        // the sender on the AP, the static routes below are the fallback
+        // for endpoints without a path
+        if (!contactPlan.empty ())
+          {
+            std::cout << "Loaded " << g_contactPlan.LoadFile (contactPlan) << " contacts from " << contactPlan << std::endl;
+          }
+        else
+          {
+            g_contactPlan.Predict (wifiNodes, contactRange, simTime, 0.1);
+          }
+        Ptr<BpContactGraphRoutingProtocol> contact = CreateObject<BpContactGraphRoutingProtocol> ();
+        contact->SetContactPlan (&g_contactPlan, 0);
+        contact->AddEndpoint (eidSender, 0);
+        contact->AddEndpoint (eidRecv, 1);
+        contact->AddNodeAddress (0, InetSocketAddress (i.GetAddress (2), 9));
+        contact->AddNodeAddress (1, InetSocketAddress (i.GetAddress (0), 9));
+        contact->AddNodeAddress (2, InetSocketAddress (i.GetAddress (1), 9));
+        g_contactRouting = contact;
+        route = contact;
+      }
+    else
+      {
+        route = CreateObject<BpStaticRoutingProtocol> ();
+      }
     route->AddRoute (eidSender, InetSocketAddress (i.GetAddress (2), 9));
     route->AddRoute (eidRecv, InetSocketAddress (i.GetAddress (0), 9));
 
@@ -142,7 +1597,7 @@ int main(int argc, char *argv[])
     bpSenderHelper.SetBpEndpointId (eidSender);
     BundleProtocolContainer bpSenders = bpSenderHelper.Install (wifiNodes.Get (0));
     bpSenders.Start (Seconds (0.1));
-    bpSenders.Stop (Seconds (1.0));
+    bpSenders.Stop (Seconds (simTime));
 
   // receiver
     BundleProtocolHelper bpReceiverHelper;
@@ -150,16 +1605,73 @@ int main(int argc, char *argv[])
     bpReceiverHelper.SetBpEndpointId (eidRecv);
     BundleProtocolContainer bpReceivers = bpReceiverHelper.Install (wifiNodes.Get (1));
     bpReceivers.Start (Seconds (0.0));
-    bpReceivers.Stop (Seconds (1.0));
+    bpReceivers.Stop (Seconds (simTime));
 
-  // send 1000 bytes bundle 
-    uint32_t size = 1000;
-    Simulator::Schedule (Seconds (0.2), &Send, bpSenders.Get (0), size, eidSender, eidRecv);
+  // send the PDUs (one of 1000 bytes by default)
+    for (uint32_t k = 0; k < nPdus; k++)
+      {
+        Simulator::Schedule (Seconds (0.2 + k * sendInterval), &Send, bpSenders.Get (0), g_pduSize, eidSender, eidRecv);
+      }
 
   // receive function
-    Simulator::Schedule (Seconds (0.8), &Receive, bpReceivers.Get (0), eidRecv);
+    if (delivery == "event")
+      {
+        g_dispatcher.Register (wifiNodes.Get (1), bpReceivers.Get (0), eidRecv, MakeCallback (&ReceiveBundles), batch);
+      }
+    else if (receiveInterval > 0)
+      {
+        Simulator::Schedule (Seconds (0.2), &PollReceive, bpReceivers.Get (0), eidRecv, Seconds (receiveInterval));
+      }
+    else
+      {
+        Simulator::Schedule (Seconds (0.8), &Receive, bpReceivers.Get (0), eidRecv);
+      }
+    if (g_useStore)
+      {
+        Simulator::Schedule (Seconds (simTime - 0.1), &Deliver, eidRecv);
+      }
 
-    Simulator::Stop (Seconds (1.0));
+    Simulator::Stop (Seconds (simTime));
+    if (allocStats > 0)
+      {
+        AllocationStats::Start (allocStats > 1);
+      }
+    SystemWallClockMs clock;
+    clock.Start ();
     Simulator::Run ();
+    int64_t wallMs = clock.End ();
+    if (allocStats > 0)
+      {
+        // compare against the same run with --packetPool toggled
+        AllocationStats::Stop ();
+        AllocationStats::Print (std::cout);
+        std::cout << "Send packets: " << g_packetPool.GetNCreated () + g_packetPool.GetNReused ()
+                  << " (" << g_packetPool.GetNReused () << " reused)" << std::endl;
+        std::cout << "Run wall time: " << wallMs << " ms" << std::endl;
+      }
+    std::cout << "PDUs delivered: " << g_nPdusDelivered << "/" << g_pduSendTimes.size ();
+    if (g_nPdusDelivered > 0)
+      {
+        std::cout << ", mean latency " << g_totalLatency.GetMilliSeconds () / g_nPdusDelivered
+                  << " ms, max " << g_maxLatency.GetMilliSeconds () << " ms";
+      }
+    std::cout << std::endl;
+    if (delivery == "event")
+      {
+        std::cout << "Drains: " << g_dispatcher.GetNDrains () << " (" << g_dispatcher.GetNDeliveries ()
+                  << " delivering)" << std::endl;
+      }
+    else
+      {
+        std::cout << "Receive calls: " << g_nReceiveCalls << std::endl;
+      }
+    Ptr<BpContactGraphRoutingProtocol> contact = DynamicCast<BpContactGraphRoutingProtocol> (route);
+    if (contact)
+      {
+        std::cout << "Contacts: " << g_contactPlan.GetNContacts () << " (" << g_contactPlan.GetNPredictions ()
+                  << " predictions), route computations: "
+                  << contact->GetRouter ().GetNComputations () << " (" << contact->GetRouter ().GetComputeMs ()
+                  << " ms)" << std::endl;
+      }
     Simulator::Destroy ();
 }
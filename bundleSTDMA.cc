@@ -6,6 +6,8 @@
 #include "ns3/network-module.h"
 #include "ns3/bp-endpoint-id.h"
 #include "ns3/bundle-protocol.h"
+#include "ns3/bp-header.h"
+#include "ns3/bp-payload-header.h"
 #include "ns3/bp-static-routing-protocol.h"
 #include "ns3/bundle-protocol-helper.h"
 #include "ns3/bundle-protocol-container.h"
@@ -26,28 +28,530 @@
 #include <iostream>
 #include <fstream>
 #include <numeric>
+#include <set>
+#include <algorithm>
+#include <ctime>
+#include <cstdlib>
+#include "allocation-stats.h"
+#include "bundle-delivery.h"
 using namespace ns3;
 NS_LOG_COMPONENT_DEFINE ("BundleProtocolSimpleExample");
 void Send (Ptr<BundleProtocol> sender, uint32_t size, BpEndpointId src, BpEndpointId dst)
 {
   std::cout << Simulator::Now ().GetMilliSeconds () << " Send a PDU with size " << size << std::endl;
 
-  Ptr<Packet> packet = Create<Packet> (size);
+  Ptr<Packet> packet = g_packetPool.Get (size);
   sender->Send (packet, src, dst);
+  g_pduSendTimes.push_back (Simulator::Now ());
 }
 
-void Receive (Ptr<BundleProtocol> receiver, BpEndpointId eid)
+/**
+ * Locates a slice of a PDU carried in its own bundle
+ */
+class PduFragmentHeader : public Header
+{
+public:
+  static TypeId GetTypeId (void)
+  {
+    static TypeId tid = TypeId ("ns3::PduFragmentHeader")
+      .SetParent<Header> ()
+      .AddConstructor<PduFragmentHeader> ();
+    return tid;
+  }
+  virtual TypeId GetInstanceTypeId (void) const
+  {
+    return GetTypeId ();
+  }
+  virtual uint32_t GetSerializedSize (void) const
+  {
+    return 12;
+  }
+  virtual void Serialize (Buffer::Iterator start) const
+  {
+    start.WriteHtonU32 (m_pdu);
+    start.WriteHtonU32 (m_offset);
+    start.WriteHtonU32 (m_total);
+  }
+  virtual uint32_t Deserialize (Buffer::Iterator start)
+  {
+    m_pdu = start.ReadNtohU32 ();
+    m_offset = start.ReadNtohU32 ();
+    m_total = start.ReadNtohU32 ();
+    return 12;
+  }
+  virtual void Print (std::ostream &os) const
+  {
+    os << "pdu=" << m_pdu << " offset=" << m_offset << " total=" << m_total;
+  }
+
+  uint32_t m_pdu;
+  uint32_t m_offset;
+  uint32_t m_total;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (PduFragmentHeader);
+
+/**
+ * A PDU being reassembled: the received slices are kept as they
+ * arrived, as views over their bundles, and never copied together
+ */
+struct PduChain
+{
+  std::map<uint32_t, Ptr<Packet> > fragments; // by offset
+  uint32_t received;
+  uint32_t total;
+  Time sent;
+};
+
+static uint32_t g_bundleSize = 400;
+static uint32_t g_nextPdu = 0;
+static std::map<uint32_t, Time> g_pduSent;
+static std::map<uint32_t, PduChain> g_pduChains;
+static uint64_t g_pduBytesDelivered = 0;
+static Time g_firstPduSent;
+static Time g_lastPduDelivered;
+
+// PDU bytes that fit in one bundle.  BundleProtocol::BundleSize
+// bounds the whole bundle: Send adds the primary block (BpHeader) and
+// the payload block header (BpPayloadHeader) to what it is given, and
+// splits anything larger.  A slice gets what is left after those
+// two and the PduFragmentHeader.
+uint32_t GetSliceSize (Ptr<BundleProtocol> sender, BpEndpointId src, BpEndpointId dst)
+{
+  UintegerValue bundleSize;
+  sender->GetAttribute ("BundleSize", bundleSize);
+  BpHeader primary;
+  primary.SetSourceEid (src);
+  primary.SetDestinationEid (dst);
+  BpPayloadHeader payload;
+  uint32_t overhead = primary.GetSerializedSize () + payload.GetSerializedSize ()
+    + PduFragmentHeader ().GetSerializedSize ();
+  NS_ABORT_MSG_UNLESS (bundleSize.Get () > overhead, "bundleSize " << bundleSize.Get ()
+                       << " leaves no room for PDU bytes after " << overhead << " bytes of headers");
+  return bundleSize.Get () - overhead;
+}
+
+// Splits the PDU into views of the payload that each fit in one
+// bundle, so BundleProtocol sends each one as it is instead of
+// copying segments
+void SendFragmented (Ptr<BundleProtocol> sender, uint32_t size, BpEndpointId src, BpEndpointId dst)
+{
+  std::cout << Simulator::Now ().GetMilliSeconds () << " Send a fragmented PDU with size " << size << std::endl;
+
+  Ptr<Packet> pdu = g_packetPool.Get (size);
+  PduFragmentHeader header;
+  header.m_pdu = g_nextPdu++;
+  header.m_total = size;
+  uint32_t slice = GetSliceSize (sender, src, dst);
+  for (uint32_t offset = 0; offset < size; offset += slice)
+    {
+      Ptr<Packet> fragment = pdu->CreateFragment (offset, std::min (slice, size - offset));
+      header.m_offset = offset;
+      fragment->AddHeader (header);
+      sender->Send (fragment, src, dst);
+    }
+  // the fragments only share its bytes
+  g_packetPool.Put (pdu);
+  if (g_pduSent.empty ())
+    {
+      g_firstPduSent = Simulator::Now ();
+    }
+  g_pduSent[header.m_pdu] = Simulator::Now ();
+}
+
+void ReceiveFragment (Ptr<Packet> p)
 {
+  PduFragmentHeader header;
+  p->RemoveHeader (header);
+  PduChain &chain = g_pduChains[header.m_pdu];
+  if (chain.fragments.empty ())
+    {
+      chain.received = 0;
+      chain.total = header.m_total;
+      chain.sent = g_pduSent[header.m_pdu];
+    }
+  if (chain.fragments.count (header.m_offset) > 0)
+    {
+      g_packetPool.Put (p);
+      return;
+    }
+  chain.fragments[header.m_offset] = p;
+  chain.received += p->GetSize ();
+  if (chain.received == chain.total)
+    {
+      Time delay = Simulator::Now () - chain.sent;
+      std::cout << Simulator::Now ().GetMilliSeconds () << " Reassembled PDU " << header.m_pdu
+                << " size " << chain.total << " from " << chain.fragments.size ()
+                << " bundles in " << delay.GetMilliSeconds () << " ms" << std::endl;
+      g_pduBytesDelivered += chain.total;
+      g_lastPduDelivered = Simulator::Now ();
+      for (std::map<uint32_t, Ptr<Packet> >::iterator i = chain.fragments.begin ();
+           i != chain.fragments.end (); ++i)
+        {
+          g_packetPool.Put (i->second);
+        }
+      g_pduChains.erase (header.m_pdu);
+    }
+}
+
+static bool g_fragment = false;
+
+static BundleDeliveryDispatcher g_dispatcher;
+
+void HandleBundle (Ptr<Packet> p)
+{
+  std::cout << Simulator::Now ().GetMilliSeconds () << " Receive bundle size " << p->GetSize () << std::endl;
+  if (g_fragment)
+    {
+      ReceiveFragment (p);
+    }
+  else
+    {
+      AccountDelivery (p->GetSize ());
+      g_packetPool.Put (p);
+    }
+}
 
+void Receive (Ptr<BundleProtocol> receiver, BpEndpointId eid)
+{
+  g_nReceiveCalls++;
   Ptr<Packet> p = receiver->Receive (eid);
   while (p != NULL)
     {
-      std::cout << Simulator::Now ().GetMilliSeconds () << " Receive bundle size " << p->GetSize () << std::endl;
+      HandleBundle (p);
       p = receiver->Receive (eid);
     }
 }
+
+void ReceiveBundles (BpEndpointId eid, const std::vector<Ptr<Packet> > &bundles)
+{
+  for (uint32_t i = 0; i < bundles.size (); i++)
+    {
+      HandleBundle (bundles[i]);
+    }
+}
+
+void PollReceive (Ptr<BundleProtocol> receiver, BpEndpointId eid, Time interval)
+{
+  Receive (receiver, eid);
+  Simulator::Schedule (interval, &PollReceive, receiver, eid, interval);
+}
+
+/**
+ * STDMA slot table of one frame kept as packed bitmaps.
+ *
+ * A set bit marks a free slot, so the free slots of a selection
+ * interval are counted with one popcount per 64 slots and the k-th
+ * candidate is found by skipping whole words.  When the interval has
+ * fewer free slots than the minimum candidate set, the slots reserved
+ * by the most distant stations are added, as StdmaMac does; only this
+ * fallback looks at individual slots.
+ */
+class StdmaSlotBitmap
+{
+public:
+  StdmaSlotBitmap (uint32_t nSlots)
+    : m_nSlots (nSlots),
+      m_free ((nSlots + 63) / 64, ~(uint64_t) 0),
+      m_owner (nSlots, 0)
+  {
+    if (nSlots % 64)
+      {
+        m_free.back () = ((uint64_t) 1 << (nSlots % 64)) - 1;
+      }
+  }
+
+  void Reserve (uint32_t slot, uint32_t owner)
+  {
+    m_free[slot / 64] &= ~((uint64_t) 1 << (slot % 64));
+    m_owner[slot] = owner;
+  }
+  void Release (uint32_t slot)
+  {
+    m_free[slot / 64] |= (uint64_t) 1 << (slot % 64);
+  }
+  bool IsFree (uint32_t slot) const
+  {
+    return (m_free[slot / 64] >> (slot % 64)) & 1;
+  }
+  uint32_t GetOwner (uint32_t slot) const
+  {
+    return m_owner[slot];
+  }
+
+  // free slots in [begin, begin + length), wrapping at the frame end
+  uint32_t CountFree (uint32_t begin, uint32_t length) const
+  {
+    if (begin + length > m_nSlots)
+      {
+        return CountRange (begin, m_nSlots) + CountRange (0, begin + length - m_nSlots);
+      }
+    return CountRange (begin, begin + length);
+  }
+
+  // the k-th free slot (from 0) of the wrapped interval at begin
+  uint32_t FindFree (uint32_t begin, uint32_t length, uint32_t k) const
+  {
+    if (begin + length > m_nSlots)
+      {
+        uint32_t first = CountRange (begin, m_nSlots);
+        if (k >= first)
+          {
+            return FindRange (0, k - first);
+          }
+      }
+    return FindRange (begin, k);
+  }
+
+  /**
+   * \brief Picks the slot for one reservation.
+   * \param begin first slot of the selection interval
+   * \param length slots in the selection interval
+   * \param minCandidates minimum size of the candidate set, at least 1
+   * \param self the selecting station
+   * \param positions station positions, for the distance fallback
+   * \param draw a uniform random number choosing among the candidates
+   * \return the selected slot
+   */
+  uint32_t Select (uint32_t begin, uint32_t length, uint32_t minCandidates, uint32_t self,
+                   const std::vector<Vector> &positions, uint32_t draw) const
+  {
+    // with no candidate there is nothing to draw from: a full interval
+    // then yields the slot of the most distant station
+    minCandidates = std::max (minCandidates, 1u);
+    NS_ABORT_MSG_UNLESS (length > 0 && length <= m_nSlots, "Selection interval of " << length << " slots");
+    uint32_t nFree = CountFree (begin, length);
+    if (nFree >= minCandidates)
+      {
+        return FindFree (begin, length, draw % nFree);
+      }
+    std::vector<uint32_t> candidates;
+    std::vector<std::pair<double, uint32_t> > used;
+    for (uint32_t i = 0; i < length; i++)
+      {
+        uint32_t slot = (begin + i) % m_nSlots;
+        if (IsFree (slot))
+          {
+            candidates.push_back (slot);
+          }
+        else
+          {
+            double distance = CalculateDistance (positions[self], positions[m_owner[slot]]);
+            used.push_back (std::make_pair (-distance, slot));
+          }
+      }
+    uint32_t nUsed = std::min<uint32_t> (minCandidates - nFree, used.size ());
+    std::partial_sort (used.begin (), used.begin () + nUsed, used.end ());
+    for (uint32_t i = 0; i < nUsed; i++)
+      {
+        candidates.push_back (used[i].second);
+      }
+    return candidates[draw % candidates.size ()];
+  }
+
+private:
+  // free slots in [begin, end), end <= m_nSlots
+  uint32_t CountRange (uint32_t begin, uint32_t end) const
+  {
+    uint32_t count = 0;
+    for (uint32_t w = begin / 64; w * 64 < end; w++)
+      {
+        count += __builtin_popcountll (m_free[w] & Mask (w, begin, end));
+      }
+    return count;
+  }
+  // the k-th free slot from begin, which must exist before the frame end
+  uint32_t FindRange (uint32_t begin, uint32_t k) const
+  {
+    for (uint32_t w = begin / 64; ; w++)
+      {
+        uint64_t word = m_free[w] & Mask (w, begin, m_nSlots);
+        uint32_t count = __builtin_popcountll (word);
+        if (k < count)
+          {
+            for (; k > 0; k--)
+              {
+                word &= word - 1;
+              }
+            return w * 64 + __builtin_ctzll (word);
+          }
+        k -= count;
+      }
+  }
+  // bits of word w that lie in [begin, end)
+  static uint64_t Mask (uint32_t w, uint32_t begin, uint32_t end)
+  {
+    uint64_t mask = ~(uint64_t) 0;
+    if (begin > w * 64)
+      {
+        mask &= ~(uint64_t) 0 << (begin - w * 64);
+      }
+    if (end < w * 64 + 64)
+      {
+        mask &= ((uint64_t) 1 << (end - w * 64)) - 1;
+      }
+    return mask;
+  }
+
+  uint32_t m_nSlots;
+  std::vector<uint64_t> m_free;
+  std::vector<uint32_t> m_owner;
+};
+
+// The same selection over a byte per slot, scanning the whole interval
+// to build the candidate set
+static uint32_t SelectSlotByScan (const std::vector<uint8_t> &free, const std::vector<uint32_t> &owner,
+                                  uint32_t begin, uint32_t length, uint32_t minCandidates, uint32_t self,
+                                  const std::vector<Vector> &positions, uint32_t draw)
+{
+  uint32_t nSlots = free.size ();
+  minCandidates = std::max (minCandidates, 1u);
+  NS_ABORT_MSG_UNLESS (length > 0 && length <= nSlots, "Selection interval of " << length << " slots");
+  std::vector<uint32_t> candidates;
+  std::vector<std::pair<double, uint32_t> > used;
+  for (uint32_t i = 0; i < length; i++)
+    {
+      uint32_t slot = (begin + i) % nSlots;
+      if (free[slot])
+        {
+          candidates.push_back (slot);
+        }
+      else
+        {
+          used.push_back (std::make_pair (-CalculateDistance (positions[self], positions[owner[slot]]), slot));
+        }
+    }
+  uint32_t nFree = candidates.size ();
+  if (nFree < minCandidates)
+    {
+      uint32_t nUsed = std::min<uint32_t> (minCandidates - nFree, used.size ());
+      std::partial_sort (used.begin (), used.begin () + nUsed, used.end ());
+      for (uint32_t i = 0; i < nUsed; i++)
+        {
+          candidates.push_back (used[i].second);
+        }
+    }
+  return candidates[draw % candidates.size ()];
+}
+
+// Fills one frame with the reservations of 10 up to maxNodes stations
+// at ReportRate 10 and times slot selection by scan and by bitmap;
+// small station counts refill the frame until about a million
+// selections, for the millisecond clock
+void RunSlotBenchmark (uint32_t maxNodes, uint32_t nSlots)
+{
+  const uint32_t reportRate = 10;
+  const uint32_t minCandidates = 4;
+  uint32_t increment = nSlots / reportRate;
+  uint32_t interval = std::max<uint32_t> (1, increment / 5);
+  std::cout << "Nodes\tSlots\tScanNs\tBitmapNs\tReused" << std::endl;
+  uint32_t counts[] = { 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000 };
+  for (uint32_t c = 0; c < sizeof (counts) / sizeof (counts[0]) && counts[c] <= maxNodes; c++)
+    {
+      uint32_t nNodes = counts[c];
+      srand (nNodes);
+      std::vector<Vector> positions;
+      std::vector<uint32_t> firstSlot;
+      for (uint32_t n = 0; n < nNodes; n++)
+        {
+          positions.push_back (Vector (rand () % 10000, rand () % 10000, 0));
+          firstSlot.push_back (rand () % nSlots);
+        }
+      std::vector<uint32_t> draws (nNodes * reportRate);
+      for (uint32_t d = 0; d < draws.size (); d++)
+        {
+          draws[d] = rand ();
+        }
+
+      uint32_t repeats = std::max<uint32_t> (1, 1000000 / draws.size ());
+      std::vector<uint32_t> scanned;
+      SystemWallClockMs clock;
+      clock.Start ();
+      for (uint32_t f = 0; f < repeats; f++)
+        {
+          std::vector<uint8_t> free (nSlots, 1);
+          std::vector<uint32_t> owner (nSlots, 0);
+          scanned.clear ();
+          for (uint32_t n = 0; n < nNodes; n++)
+            {
+              for (uint32_t r = 0; r < reportRate; r++)
+                {
+                  uint32_t nominal = firstSlot[n] + r * increment;
+                  uint32_t slot = SelectSlotByScan (free, owner, (nominal + nSlots - interval / 2) % nSlots, interval,
+                                                    minCandidates, n, positions, draws[n * reportRate + r]);
+                  free[slot] = 0;
+                  owner[slot] = n;
+                  scanned.push_back (slot);
+                }
+            }
+        }
+      double scanMs = clock.End ();
+
+      uint32_t mismatches = 0;
+      uint32_t reused = 0;
+      clock.Start ();
+      for (uint32_t f = 0; f < repeats; f++)
+        {
+          StdmaSlotBitmap table (nSlots);
+          mismatches = 0;
+          reused = 0;
+          for (uint32_t n = 0; n < nNodes; n++)
+            {
+              for (uint32_t r = 0; r < reportRate; r++)
+                {
+                  uint32_t nominal = firstSlot[n] + r * increment;
+                  uint32_t slot = table.Select ((nominal + nSlots - interval / 2) % nSlots, interval,
+                                                minCandidates, n, positions, draws[n * reportRate + r]);
+                  reused += !table.IsFree (slot);
+                  table.Reserve (slot, n);
+                  mismatches += slot != scanned[n * reportRate + r];
+                }
+            }
+        }
+      double bitmapMs = clock.End ();
+      double nSelections = (double) draws.size () * repeats;
+      std::cout << nNodes << "\t" << nSlots << "\t" << scanMs * 1e6 / nSelections << "\t"
+                << bitmapMs * 1e6 / nSelections << "\t" << reused
+                << (mismatches ? "\t(selections differ)" : "") << std::endl;
+    }
+}
 int main(int argc, char *argv[])
 {
+    double simTime = 1.0;
+    uint32_t nPdus = 1;
+    double sendInterval = 0.1;
+    std::string delivery = "poll";
+    uint32_t batch = 1;
+    double receiveInterval = 0;
+    std::string l4 = "Tcp";
+    uint32_t slotBenchmark = 0;
+    uint32_t slotsPerFrame = 1500;
+    uint32_t allocStats = 1;
+    bool packetPool = false;
+    CommandLine cmd;
+    cmd.AddValue ("allocStats", "0=off;1=count heap allocations during Run;2=also time malloc/free", allocStats);
+    cmd.AddValue ("packetPool", "Reuse the packets the bundle sinks are done with for sends", packetPool);
+    cmd.AddValue ("pduSize", "Size of the PDU sent (bytes)", g_pduSize);
+    cmd.AddValue ("nPdus", "Number of PDUs sent", nPdus);
+    cmd.AddValue ("sendInterval", "Time between two PDUs (s)", sendInterval);
+    cmd.AddValue ("delivery", "poll: call Receive on a schedule; event: deliver on arrival", delivery);
+    cmd.AddValue ("batch", "Bundles per delivery callback (delivery=event)", batch);
+    cmd.AddValue ("bundleSize", "BundleProtocol bundle size (bytes)", g_bundleSize);
+    cmd.AddValue ("fragment", "Send the PDU as zero-copy fragments and reassemble it", g_fragment);
+    cmd.AddValue ("l4", "Bundle convergence layer (Tcp or Udp)", l4);
+    cmd.AddValue ("simTime", "Simulated time (s)", simTime);
+    cmd.AddValue ("receiveInterval", "Poll the receiver every interval (s), 0=once at 0.8 s", receiveInterval);
+    cmd.AddValue ("slotBenchmark", "Time STDMA slot selection for up to this many stations, then exit", slotBenchmark);
+    cmd.AddValue ("slotsPerFrame", "Slots in one frame of the slot benchmark", slotsPerFrame);
+    cmd.Parse (argc, argv);
+    g_packetPool.SetEnabled (packetPool);
+    if (slotBenchmark > 0)
+      {
+        RunSlotBenchmark (slotBenchmark, slotsPerFrame);
+        return 0;
+      }
+    uint32_t size = g_pduSize;
+
     // // STDMA init
     stdma::StdmaHelper stdma;
     stdma.SetStandard(WIFI_PHY_STANDARD_80211p_CCH);
@@ -86,9 +590,9 @@ int main(int argc, char *argv[])
     NS_LOG_INFO ("Create bundle applications.");
  
     std::ostringstream l4type;
-    l4type << "Tcp";
+    l4type << l4;
     Config::SetDefault ("ns3::BundleProtocol::L4Type", StringValue (l4type.str ()));
-    Config::SetDefault ("ns3::BundleProtocol::BundleSize", UintegerValue (400)); 
+    Config::SetDefault ("ns3::BundleProtocol::BundleSize", UintegerValue (g_bundleSize)); 
     Config::SetDefault ("ns3::TcpSocket::SegmentSize", UintegerValue (512));
 
     // build endpoint ids
@@ -106,7 +610,7 @@ int main(int argc, char *argv[])
     bpSenderHelper.SetBpEndpointId (eidSender);
     BundleProtocolContainer bpSenders = bpSenderHelper.Install (wifiNodes.Get (0));
     bpSenders.Start (Seconds (0.1));
-    bpSenders.Stop (Seconds (1.0));
+    bpSenders.Stop (Seconds (simTime));
 
   // receiver
     BundleProtocolHelper bpReceiverHelper;
@@ -114,17 +618,83 @@ int main(int argc, char *argv[])
     bpReceiverHelper.SetBpEndpointId (eidRecv);
     BundleProtocolContainer bpReceivers = bpReceiverHelper.Install (wifiNodes.Get (1));
     bpReceivers.Start (Seconds (0.0));
-    bpReceivers.Stop (Seconds (1.0));
+    bpReceivers.Stop (Seconds (simTime));
 
-  // send 1000 bytes bundle 
-    uint32_t size = 1000;
-    Simulator::Schedule (Seconds (0.2), &Send, bpSenders.Get (0), size, eidSender, eidRecv);
+  // send the PDUs (one of 1000 bytes by default)
+    for (uint32_t k = 0; k < nPdus; k++)
+      {
+        Time at = Seconds (0.2 + k * sendInterval);
+        if (g_fragment)
+          {
+            Simulator::Schedule (at, &SendFragmented, bpSenders.Get (0), size, eidSender, eidRecv);
+          }
+        else
+          {
+            Simulator::Schedule (at, &Send, bpSenders.Get (0), size, eidSender, eidRecv);
+          }
+      }
 
   // receive function
-    Simulator::Schedule (Seconds (0.8), &Receive, bpReceivers.Get (0), eidRecv);
+    if (delivery == "event")
+      {
+        g_dispatcher.Register (wifiNodes.Get (1), bpReceivers.Get (0), eidRecv, MakeCallback (&ReceiveBundles), batch);
+      }
+    else if (receiveInterval > 0)
+      {
+        Simulator::Schedule (Seconds (0.2), &PollReceive, bpReceivers.Get (0), eidRecv, Seconds (receiveInterval));
+      }
+    else
+      {
+        Simulator::Schedule (Seconds (0.8), &Receive, bpReceivers.Get (0), eidRecv);
+      }
 
-    Simulator::Stop (Seconds (1.0));
+    Simulator::Stop (Seconds (simTime));
     AnimationInterface anim("bundle.xml");
+    if (allocStats > 0)
+      {
+        AllocationStats::Start (allocStats > 1);
+      }
+    SystemWallClockMs clock;
+    clock.Start ();
     Simulator::Run ();
+    int64_t wallMs = clock.End ();
+    if (allocStats > 0)
+      {
+        // compare against the same run with --packetPool toggled
+        AllocationStats::Stop ();
+        AllocationStats::Print (std::cout);
+        std::cout << "Send packets: " << g_packetPool.GetNCreated () + g_packetPool.GetNReused ()
+                  << " (" << g_packetPool.GetNReused () << " reused)" << std::endl;
+        std::cout << "Run wall time: " << wallMs << " ms" << std::endl;
+      }
+    if (!g_fragment)
+      {
+        std::cout << "PDUs delivered: " << g_nPdusDelivered << "/" << g_pduSendTimes.size ();
+        if (g_nPdusDelivered > 0)
+          {
+            std::cout << ", mean latency " << g_totalLatency.GetMilliSeconds () / g_nPdusDelivered
+                      << " ms, max " << g_maxLatency.GetMilliSeconds () << " ms";
+          }
+        std::cout << std::endl;
+        if (delivery == "event")
+          {
+            std::cout << "Drains: " << g_dispatcher.GetNDrains () << " (" << g_dispatcher.GetNDeliveries ()
+                      << " delivering)" << std::endl;
+          }
+        else
+          {
+            std::cout << "Receive calls: " << g_nReceiveCalls << std::endl;
+          }
+      }
+    if (g_fragment)
+      {
+        double seconds = (g_lastPduDelivered - g_firstPduSent).GetSeconds ();
+        std::cout << "Delivered " << g_pduBytesDelivered << " bytes";
+        if (g_pduBytesDelivered > 0 && seconds > 0)
+          {
+            std::cout << " at " << g_pduBytesDelivered * 8.0 / 1000 / seconds << " kbps";
+          }
+        std::cout << ", wall time " << wallMs << " ms" << std::endl;
+      }
     Simulator::Destroy ();
 }
\ No newline at end of file
@@ -1,5 +1,32 @@
 #include <fstream>
 #include <iostream>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <deque>
+#include <queue>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <limits>
+#include <typeinfo>
+#include <cctype>
+#include <new>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 #include "ns3/core-module.h"
 #include "ns3/network-module.h"
 #include "ns3/internet-module.h"
@@ -20,6 +47,12 @@
 #include "ns3/wave-bsm-helper.h"
 #include "ns3/wave-helper.h"
 #include "ns3/netanim-module.h"
+#include "ns3/stdma-module.h"
+#include "ns3/system-thread.h"
+#include "ns3/system-mutex.h"
+#include "ns3/system-condition.h"
+#include "allocation-stats.h"
+#include "table-error-rate-model.h"
 
 using namespace ns3;
 
@@ -38,25 +71,25 @@ public:
    * \brief Returns the number of bytes received
    * \return the number of bytes received
    */
-  uint32_t GetRxBytes ();
+  uint64_t GetRxBytes ();
 
   /**
    * \brief Returns the cumulative number of bytes received
    * \return the cumulative number of bytes received
    */
-  uint32_t GetCumulativeRxBytes ();
+  uint64_t GetCumulativeRxBytes ();
 
   /**
    * \brief Returns the count of packets received
    * \return the count of packets received
    */
-  uint32_t GetRxPkts ();
+  uint64_t GetRxPkts ();
 
   /**
    * \brief Returns the cumulative count of packets received
    * \return the cumulative count of packets received
    */
-  uint32_t GetCumulativeRxPkts ();
+  uint64_t GetCumulativeRxPkts ();
 
   /**
    * \brief Increments the number of (application-data)
@@ -64,7 +97,7 @@ public:
    * \param rxBytes the number of bytes received
    * \return none
    */
-  void IncRxBytes (uint32_t rxBytes);
+  void IncRxBytes (uint64_t rxBytes);
 
   /**
    * \brief Increments the count of packets received
@@ -77,46 +110,46 @@ public:
    * \param rxBytes the number of bytes received
    * \return none
    */
-  void SetRxBytes (uint32_t rxBytes);
+  void SetRxBytes (uint64_t rxBytes);
 
   /**
    * \brief Sets the number of packets received
    * \param rxPkts the number of packets received
    * \return none
    */
-  void SetRxPkts (uint32_t rxPkts);
+  void SetRxPkts (uint64_t rxPkts);
 
   /**
    * \brief Returns the number of bytes transmitted
    * \return the number of bytes transmitted
    */
-  uint32_t GetTxBytes ();
+  uint64_t GetTxBytes ();
 
   /**
    * \brief Returns the cumulative number of bytes transmitted
    * \param socket the receiving socket
    * \return none
    */
-  uint32_t GetCumulativeTxBytes ();
+  uint64_t GetCumulativeTxBytes ();
 
   /**
    * \brief Returns the number of packets transmitted
    * \return the number of packets transmitted
    */
-  uint32_t GetTxPkts ();
+  uint64_t GetTxPkts ();
 
   /**
    * \brief Returns the cumulative number of packets transmitted
    * \return the cumulative number of packets transmitted
    */
-  uint32_t GetCumulativeTxPkts ();
+  uint64_t GetCumulativeTxPkts ();
 
   /**
    * \brief Increment the number of bytes transmitted
    * \param txBytes the number of addtional bytes transmitted
    * \return none
    */
-  void IncTxBytes (uint32_t txBytes);
+  void IncTxBytes (uint64_t txBytes);
 
   /**
    * \brief Increment the count of packets transmitted
@@ -129,24 +162,39 @@ public:
    * \param txBytes the number of bytes transmitted
    * \return none
    */
-  void SetTxBytes (uint32_t txBytes);
+  void SetTxBytes (uint64_t txBytes);
 
   /**
    * \brief Sets the number of packets transmitted
    * \param txPkts the number of packets transmitted
    * \return none
    */
-  void SetTxPkts (uint32_t txPkts);
+  void SetTxPkts (uint64_t txPkts);
+
+  /**
+   * \brief Adds the delay of a received packet
+   * \param delay time from the OnOff send to the sink
+   * \return none
+   */
+  void AddDelay (Time delay);
+
+  /**
+   * \brief Returns the mean delay of the received packets
+   * \return the mean delay
+   */
+  Time GetMeanDelay ();
 
 private:
-  uint32_t m_RxBytes;
-  uint32_t m_cumulativeRxBytes;
-  uint32_t m_RxPkts;
-  uint32_t m_cumulativeRxPkts;
-  uint32_t m_TxBytes;
-  uint32_t m_cumulativeTxBytes;
-  uint32_t m_TxPkts;
-  uint32_t m_cumulativeTxPkts;
+  uint64_t m_RxBytes;
+  uint64_t m_cumulativeRxBytes;
+  uint64_t m_RxPkts;
+  uint64_t m_cumulativeRxPkts;
+  uint64_t m_TxBytes;
+  uint64_t m_cumulativeTxBytes;
+  uint64_t m_TxPkts;
+  uint64_t m_cumulativeTxPkts;
+  Time m_cumulativeDelay;
+  uint64_t m_delayPkts;
 };
 
 RoutingStats::RoutingStats ()
@@ -157,36 +205,38 @@ RoutingStats::RoutingStats ()
     m_TxBytes (0),
     m_cumulativeTxBytes (0),
     m_TxPkts (0),
-    m_cumulativeTxPkts (0)
+    m_cumulativeTxPkts (0),
+    m_cumulativeDelay (Seconds (0)),
+    m_delayPkts (0)
 {
 }
 
-uint32_t
+uint64_t
 RoutingStats::GetRxBytes ()
 {
   return m_RxBytes;
 }
 
-uint32_t
+uint64_t
 RoutingStats::GetCumulativeRxBytes ()
 {
   return m_cumulativeRxBytes;
 }
 
-uint32_t
+uint64_t
 RoutingStats::GetRxPkts ()
 {
   return m_RxPkts;
 }
 
-uint32_t
+uint64_t
 RoutingStats::GetCumulativeRxPkts ()
 {
   return m_cumulativeRxPkts;
 }
 
 void
-RoutingStats::IncRxBytes (uint32_t rxBytes)
+RoutingStats::IncRxBytes (uint64_t rxBytes)
 {
   m_RxBytes += rxBytes;
   m_cumulativeRxBytes += rxBytes;
@@ -200,43 +250,43 @@ RoutingStats::IncRxPkts ()
 }
 
 void
-RoutingStats::SetRxBytes (uint32_t rxBytes)
+RoutingStats::SetRxBytes (uint64_t rxBytes)
 {
   m_RxBytes = rxBytes;
 }
 
 void
-RoutingStats::SetRxPkts (uint32_t rxPkts)
+RoutingStats::SetRxPkts (uint64_t rxPkts)
 {
   m_RxPkts = rxPkts;
 }
 
-uint32_t
+uint64_t
 RoutingStats::GetTxBytes ()
 {
   return m_TxBytes;
 }
 
-uint32_t
+uint64_t
 RoutingStats::GetCumulativeTxBytes ()
 {
   return m_cumulativeTxBytes;
 }
 
-uint32_t
+uint64_t
 RoutingStats::GetTxPkts ()
 {
   return m_TxPkts;
 }
 
-uint32_t
+uint64_t
 RoutingStats::GetCumulativeTxPkts ()
 {
   return m_cumulativeTxPkts;
 }
 
 void
-RoutingStats::IncTxBytes (uint32_t txBytes)
+RoutingStats::IncTxBytes (uint64_t txBytes)
 {
   m_TxBytes += txBytes;
   m_cumulativeTxBytes += txBytes;
@@ -250,17 +300,354 @@ RoutingStats::IncTxPkts ()
 }
 
 void
-RoutingStats::SetTxBytes (uint32_t txBytes)
+RoutingStats::SetTxBytes (uint64_t txBytes)
 {
   m_TxBytes = txBytes;
 }
 
 void
-RoutingStats::SetTxPkts (uint32_t txPkts)
+RoutingStats::SetTxPkts (uint64_t txPkts)
 {
   m_TxPkts = txPkts;
 }
 
+void
+RoutingStats::AddDelay (Time delay)
+{
+  m_cumulativeDelay += delay;
+  m_delayPkts++;
+}
+
+Time
+RoutingStats::GetMeanDelay ()
+{
+  if (m_delayPkts == 0)
+    {
+      return Seconds (0);
+    }
+  return TimeStep (m_cumulativeDelay.GetTimeStep () / static_cast<int64_t> (m_delayPkts));
+}
+
+
+/**
+ * \brief Connects trace sources directly on installed objects.
+ *
+ * Config::Connect with a wildcard path resolves the path against every
+ * node and application, which gets slow with thousands of nodes.
+ * These helpers connect on the objects themselves and pass the same
+ * context string Config::Connect would, so sinks parsing the context
+ * work unchanged.
+ */
+class TraceBinder
+{
+public:
+  /**
+   * \brief Connects a trace source of every application
+   * \param apps the applications
+   * \param tid the application type, as used in the config path
+   * \param traceSource the trace source name
+   * \param cb the callback, receiving the config path as context
+   * \return the number of connected applications
+   */
+  static uint32_t ConnectApplications (ApplicationContainer & apps,
+                                       std::string tid,
+                                       std::string traceSource,
+                                       const CallbackBase & cb);
+
+  /**
+   * \brief Connects the CourseChange trace source of every node's mobility model
+   * \param c node container
+   * \param cb the callback, receiving the config path as context
+   * \return the number of connected mobility models
+   */
+  static uint32_t ConnectCourseChange (NodeContainer & c, const CallbackBase & cb);
+
+  /**
+   * \brief Parses the node id of a "/NodeList/<id>/..." context; aborts
+   * if the context is not of that form
+   * \param context the config path passed to a trace sink
+   * \return the node id
+   */
+  static uint32_t GetNodeId (const std::string & context);
+};
+
+uint32_t
+TraceBinder::ConnectApplications (ApplicationContainer & apps,
+                                  std::string tid,
+                                  std::string traceSource,
+                                  const CallbackBase & cb)
+{
+  uint32_t connected = 0;
+  for (uint32_t i = 0; i < apps.GetN (); i++)
+    {
+      Ptr<Application> app = apps.Get (i);
+      Ptr<Node> node = app->GetNode ();
+      uint32_t index = 0;
+      while (index < node->GetNApplications () && node->GetApplication (index) != app)
+        {
+          index++;
+        }
+      std::ostringstream context;
+      context << "/NodeList/" << node->GetId () << "/ApplicationList/" << index
+              << "/$" << tid << "/" << traceSource;
+      if (app->TraceConnect (traceSource, context.str (), cb))
+        {
+          connected++;
+        }
+    }
+  return connected;
+}
+
+uint32_t
+TraceBinder::GetNodeId (const std::string & context)
+{
+  static const std::string prefix = "/NodeList/";
+  std::string::size_type end = context.find ('/', prefix.size ());
+  NS_ABORT_MSG_UNLESS (context.compare (0, prefix.size (), prefix) == 0
+                       && end != std::string::npos && end > prefix.size ()
+                       && context.find_first_not_of ("0123456789", prefix.size ()) == end,
+                       "Trace context without a node id: " << context);
+  return std::strtoul (context.c_str () + prefix.size (), NULL, 10);
+}
+
+uint32_t
+TraceBinder::ConnectCourseChange (NodeContainer & c, const CallbackBase & cb)
+{
+  uint32_t connected = 0;
+  for (uint32_t i = 0; i < c.GetN (); i++)
+    {
+      Ptr<MobilityModel> mobility = c.Get (i)->GetObject<MobilityModel> ();
+      if (mobility == 0)
+        {
+          continue;
+        }
+      std::ostringstream context;
+      context << "/NodeList/" << c.Get (i)->GetId () << "/$ns3::MobilityModel/CourseChange";
+      if (mobility->TraceConnect ("CourseChange", context.str (), cb))
+        {
+          connected++;
+        }
+    }
+  return connected;
+}
+
+/**
+ * \brief Per-node 64-bit traffic counters rolled into fixed time buckets.
+ *
+ * All counters live in one flat array indexed by
+ * [bucket][node][counter], so an update is a single indexed add.  Each
+ * node belongs to at most one routed flow (as its source or its sink),
+ * which gives the per-flow view.
+ */
+class RoutingStatsHistory
+{
+public:
+  /**
+   * \brief Counters kept per node and bucket
+   */
+  enum Counter
+  {
+    TX_BYTES = 0,
+    TX_PKTS,
+    RX_BYTES,
+    RX_PKTS,
+    N_COUNTERS
+  };
+
+  /**
+   * \brief Constructor
+   * \return none
+   */
+  RoutingStatsHistory ();
+
+  /**
+   * \brief Sizes the history; a zero bucket width disables it
+   * \param nNodes number of node ids to track
+   * \param bucket the width of a time bucket
+   * \return none
+   */
+  void Setup (uint32_t nNodes, Time bucket);
+
+  /**
+   * \brief Returns true if the history records updates
+   * \return true if enabled
+   */
+  bool IsEnabled () const;
+
+  /**
+   * \brief Assigns a node to a flow
+   * \param nodeId the node id
+   * \param flowId the flow the node sends or receives
+   * \return none
+   */
+  void SetFlow (uint32_t nodeId, uint32_t flowId);
+
+  /**
+   * \brief Adds to a counter of the current time bucket
+   * \param nodeId the node id
+   * \param counter the counter
+   * \param value the amount to add
+   * \return none
+   */
+  void Add (uint32_t nodeId, Counter counter, uint64_t value);
+
+  /**
+   * \brief Returns a counter
+   * \param bucket the time bucket
+   * \param nodeId the node id
+   * \param counter the counter
+   * \return the counter value
+   */
+  uint64_t Get (uint32_t bucket, uint32_t nodeId, Counter counter) const;
+
+  /**
+   * \brief Returns the number of time buckets recorded so far
+   * \return the number of buckets
+   */
+  uint32_t GetNBuckets () const;
+
+  /**
+   * \brief Writes the non-empty rows as CSV
+   * \param fileName the output file
+   * \return true on success
+   */
+  bool WriteCsv (std::string fileName) const;
+
+  /**
+   * \brief Writes a header and the raw counter array
+   * \param fileName the output file
+   * \return true on success
+   */
+  bool WriteBinary (std::string fileName) const;
+
+private:
+  uint32_t m_nNodes;
+  int64_t m_bucketSteps;             // bucket width in time steps
+  std::vector<uint32_t> m_flows;     // per node, NO_FLOW if none
+  std::vector<uint64_t> m_counters;
+
+  static const uint32_t NO_FLOW = 0xffffffff;
+};
+
+RoutingStatsHistory::RoutingStatsHistory ()
+  : m_nNodes (0),
+    m_bucketSteps (0)
+{
+}
+
+void
+RoutingStatsHistory::Setup (uint32_t nNodes, Time bucket)
+{
+  m_nNodes = nNodes;
+  m_bucketSteps = bucket.GetTimeStep ();
+  m_flows.assign (nNodes, NO_FLOW);
+  m_counters.clear ();
+}
+
+bool
+RoutingStatsHistory::IsEnabled () const
+{
+  return m_bucketSteps > 0;
+}
+
+void
+RoutingStatsHistory::SetFlow (uint32_t nodeId, uint32_t flowId)
+{
+  if (nodeId < m_nNodes)
+    {
+      m_flows[nodeId] = flowId;
+    }
+}
+
+void
+RoutingStatsHistory::Add (uint32_t nodeId, Counter counter, uint64_t value)
+{
+  if (m_bucketSteps <= 0 || nodeId >= m_nNodes)
+    {
+      return;
+    }
+  uint64_t bucket = Simulator::Now ().GetTimeStep () / m_bucketSteps;
+  uint64_t index = (bucket * m_nNodes + nodeId) * N_COUNTERS + counter;
+  if (index >= m_counters.size ())
+    {
+      m_counters.resize ((bucket + 1) * m_nNodes * N_COUNTERS, 0);
+    }
+  m_counters[index] += value;
+}
+
+uint64_t
+RoutingStatsHistory::Get (uint32_t bucket, uint32_t nodeId, Counter counter) const
+{
+  uint64_t index = (static_cast<uint64_t> (bucket) * m_nNodes + nodeId) * N_COUNTERS + counter;
+  return index < m_counters.size () ? m_counters[index] : 0;
+}
+
+uint32_t
+RoutingStatsHistory::GetNBuckets () const
+{
+  if (m_nNodes == 0)
+    {
+      return 0;
+    }
+  return m_counters.size () / (m_nNodes * N_COUNTERS);
+}
+
+bool
+RoutingStatsHistory::WriteCsv (std::string fileName) const
+{
+  std::ofstream out (fileName.c_str ());
+  if (!out)
+    {
+      return false;
+    }
+  out << "Time,Node,Flow,TxBytes,TxPkts,RxBytes,RxPkts\n";
+  double width = TimeStep (m_bucketSteps).GetSeconds ();
+  const uint64_t *row = m_counters.empty () ? NULL : &m_counters[0];
+  for (uint32_t bucket = 0; bucket < GetNBuckets (); bucket++)
+    {
+      for (uint32_t node = 0; node < m_nNodes; node++, row += N_COUNTERS)
+        {
+          if (row[TX_BYTES] == 0 && row[TX_PKTS] == 0 && row[RX_BYTES] == 0 && row[RX_PKTS] == 0)
+            {
+              continue;
+            }
+          out << bucket * width << "," << node << ",";
+          if (m_flows[node] != NO_FLOW)
+            {
+              out << m_flows[node];
+            }
+          out << "," << row[TX_BYTES] << "," << row[TX_PKTS]
+              << "," << row[RX_BYTES] << "," << row[RX_PKTS] << "\n";
+        }
+    }
+  return true;
+}
+
+bool
+RoutingStatsHistory::WriteBinary (std::string fileName) const
+{
+  FILE *out = std::fopen (fileName.c_str (), "wb");
+  if (out == NULL)
+    {
+      return false;
+    }
+  // header: bucket width (ns), nodes, buckets, counters; then the
+  // per-node flow ids and the counters in [bucket][node][counter] order
+  int64_t widthNs = TimeStep (m_bucketSteps).GetNanoSeconds ();
+  uint32_t header[3] = { m_nNodes, GetNBuckets (), N_COUNTERS };
+  std::fwrite (&widthNs, sizeof (widthNs), 1, out);
+  std::fwrite (header, sizeof (header), 1, out);
+  if (m_nNodes > 0)
+    {
+      std::fwrite (&m_flows[0], sizeof (uint32_t), m_nNodes, out);
+    }
+  if (!m_counters.empty ())
+    {
+      std::fwrite (&m_counters[0], sizeof (uint64_t), m_counters.size (), out);
+    }
+  std::fclose (out);
+  return true;
+}
 
 class RoutingHelper : public Object
 {
@@ -318,6 +705,25 @@ public:
    */
   RoutingStats & GetRoutingStats ();
 
+  /**
+   * \brief Enables the per-node history; call before Install
+   * \param bucket the width of a time bucket
+   * \return none
+   */
+  void EnableHistory (Time bucket);
+
+  /**
+   * \brief Returns the per-node, time-bucketed statistics
+   * \return the RoutingStatsHistory instance
+   */
+  RoutingStatsHistory & GetRoutingStatsHistory ();
+
+  /**
+   * \brief Returns the OnOff applications installed by Install
+   * \return the application container
+   */
+  ApplicationContainer & GetApplications ();
+
   /**
    * \brief Enable/disable logging
    * \param log non-zero to enable logging
@@ -372,6 +778,11 @@ private:
   uint32_t m_nSinks;              // number of sink nodes (< all nodes)
   int m_routingTables;      // dump routing table (at t=5 sec).  0=No, 1=Yes
   RoutingStats routingStats;
+  RoutingStatsHistory m_history;
+  ApplicationContainer m_apps;
+  // send time by packet uid; a fixed table so lost packets cost nothing
+  std::vector<std::pair<uint64_t, Time> > m_txTimes;
+  Time m_historyBucket;
   std::string m_protocolName;
   int m_log;
 };
@@ -393,6 +804,8 @@ RoutingHelper::RoutingHelper ()
     m_port (9),
     m_nSinks (0),
     m_routingTables (0),
+    m_txTimes (1 << 16, std::make_pair (static_cast<uint64_t> (0), Seconds (0))),
+    m_historyBucket (Seconds (0)),
     m_log (0)
 {
 }
@@ -414,6 +827,7 @@ RoutingHelper::Install (NodeContainer & c,
   m_protocol = protocol;
   m_nSinks = nSinks;
   m_routingTables = routingTables;
+  m_history.Setup (NodeList::GetNNodes (), m_historyBucket);
 
   SetupRoutingProtocol (c);
   AssignIpAddresses (d, i);
@@ -481,12 +895,16 @@ RoutingHelper::SetupRoutingMessages (NodeContainer & c,
           Ptr<Socket> sink = SetupRoutingPacketReceive (adhocTxInterfaces.GetAddress (i), c.Get (i));
         }
 
+      m_history.SetFlow (c.Get (i)->GetId (), i);
+      m_history.SetFlow (c.Get (i + m_nSinks)->GetId (), i);
+
       AddressValue remoteAddress (InetSocketAddress (adhocTxInterfaces.GetAddress (i), m_port));
       onoff1.SetAttribute ("Remote", remoteAddress);
 
       ApplicationContainer temp = onoff1.Install (c.Get (i + m_nSinks));
       temp.Start (Seconds (var->GetValue (1.0,2.0)));
       temp.Stop (Seconds (m_TotalSimTime));
+      m_apps.Add (temp);
     }
 }
 
@@ -522,6 +940,14 @@ RoutingHelper::ReceiveRoutingPacket (Ptr<Socket> socket)
       uint32_t RxRoutingBytes = packet->GetSize ();
       GetRoutingStats ().IncRxBytes (RxRoutingBytes);
       GetRoutingStats ().IncRxPkts ();
+      uint32_t nodeId = socket->GetNode ()->GetId ();
+      m_history.Add (nodeId, RoutingStatsHistory::RX_BYTES, RxRoutingBytes);
+      m_history.Add (nodeId, RoutingStatsHistory::RX_PKTS, 1);
+      std::pair<uint64_t, Time> & sent = m_txTimes[packet->GetUid () % m_txTimes.size ()];
+      if (sent.first == packet->GetUid ())
+        {
+          GetRoutingStats ().AddDelay (Simulator::Now () - sent.second);
+        }
       if (m_log != 0)
         {
           NS_LOG_UNCOND (m_protocolName + " " + PrintReceivedRoutingPacket (socket, packet));
@@ -534,6 +960,16 @@ RoutingHelper::OnOffTrace (std::string context, Ptr<const Packet> packet)
 {
   uint32_t pktBytes = packet->GetSize ();
   routingStats.IncTxBytes (pktBytes);
+  routingStats.IncTxPkts ();
+  std::pair<uint64_t, Time> & sent = m_txTimes[packet->GetUid () % m_txTimes.size ()];
+  sent.first = packet->GetUid ();
+  sent.second = Simulator::Now ();
+  if (m_history.IsEnabled ())
+    {
+      uint32_t nodeId = TraceBinder::GetNodeId (context);
+      m_history.Add (nodeId, RoutingStatsHistory::TX_BYTES, pktBytes);
+      m_history.Add (nodeId, RoutingStatsHistory::TX_PKTS, 1);
+    }
 }
 
 RoutingStats &
@@ -543,765 +979,5634 @@ RoutingHelper::GetRoutingStats ()
 }
 
 void
-RoutingHelper::SetLogging (int log)
+RoutingHelper::EnableHistory (Time bucket)
 {
-  m_log = log;
+  m_historyBucket = bucket;
 }
 
-class WifiApp
+RoutingStatsHistory &
+RoutingHelper::GetRoutingStatsHistory ()
 {
-public:
-  /**
-   * \brief Constructor
-   * \return none
-   */
-  WifiApp ();
-
-  /**
-   * \brief Destructor
-   * \return none
-   */
-  virtual ~WifiApp ();
-
-  /**
-   * \brief Enacts simulation of an ns-3 wifi application
-   * \param argc program arguments count
-   * \param argv program arguments
-   * \return none
-   */
-  void Simulate (int argc, char **argv);
+  return m_history;
+}
 
-protected:
-  /**
-   * \brief Sets default attribute values
-   * \return none
-   */
-  virtual void SetDefaultAttributeValues ();
+ApplicationContainer &
+RoutingHelper::GetApplications ()
+{
+  return m_apps;
+}
 
-  /**
-   * \brief Process command line arguments
-   * \param argc program arguments count
-   * \param argv program arguments
-   * \return none
-   */
-  virtual void ParseCommandLineArguments (int argc, char **argv);
+void
+RoutingHelper::SetLogging (int log)
+{
+  m_log = log;
+}
 
+/**
+ * \brief Skips the wrapped propagation loss computation for receivers
+ * beyond the range at which a frame drops below a receive power floor.
+ *
+ * Culled receivers get a fixed, negligible receive power.  The range is
+ * derived once from the link budget by searching the distance at which
+ * the wrapped model drops below the floor.  YansWifiChannel still
+ * delivers every frame to every PHY; only the loss evaluation of the
+ * distant ones is saved.  Below the energy detection threshold a frame
+ * still counts as interference, so the floor should lie well below the
+ * noise floor: a culled frame at m dB below the noise would have raised
+ * the noise by at most 10 log10 (1 + 10^(-m/10)) dB.
+ */
+class RangeCulledPropagationLossModel : public PropagationLossModel
+{
+public:
   /**
-   * \brief Configure nodes
-   * \return none
+   * \brief Get class TypeId
+   * \return the TypeId for the class
    */
-  virtual void ConfigureNodes ();
+  static TypeId GetTypeId (void);
 
   /**
-   * \brief Configure channels
+   * \brief Constructor
    * \return none
    */
-  virtual void ConfigureChannels ();
+  RangeCulledPropagationLossModel ();
 
   /**
-   * \brief Configure devices
+   * \brief Sets the model computing the loss of receivers in range
+   * \param inner the wrapped propagation loss model
    * \return none
    */
-  virtual void ConfigureDevices ();
+  void SetInner (Ptr<PropagationLossModel> inner);
 
   /**
-   * \brief Configure mobility
-   * \return none
+   * \brief Sets the range from the link budget of the wrapped model
+   * \param txPowerDbm maximum transmit power, including antenna gains
+   * \param floorDbm the receive power below which links are culled
+   * \return the resulting maximum range in meters
    */
-  virtual void ConfigureMobility ();
+  double SetLinkBudget (double txPowerDbm, double floorDbm);
 
   /**
-   * \brief Configure applications
-   * \return none
+   * \brief Returns the maximum range
+   * \return the maximum range in meters
    */
-  virtual void ConfigureApplications ();
+  double GetMaxRange () const;
 
   /**
-   * \brief Configure tracing
-   * \return none
+   * \brief Returns the number of links evaluated by the wrapped model
+   * \return the number of evaluated links
    */
-  virtual void ConfigureTracing ();
+  uint64_t GetNEvaluated () const;
 
   /**
-   * \brief Run the simulation
-   * \return none
+   * \brief Returns the number of links culled by range
+   * \return the number of culled links
    */
-  virtual void RunSimulation ();
+  uint64_t GetNCulled () const;
 
-  /**
-   * \brief Process outputs
-   * \return none
-   */
-  virtual void ProcessOutputs ();
+private:
+  virtual double DoCalcRxPower (double txPowerDbm,
+                                Ptr<MobilityModel> a,
+                                Ptr<MobilityModel> b) const;
+  virtual int64_t DoAssignStreams (int64_t stream);
+
+  Ptr<PropagationLossModel> m_inner;
+  double m_maxRange;       // meters
+  double m_maxRangeSquared;
+  double m_culledRxPowerDbm;
+  mutable uint64_t m_nEvaluated;
+  mutable uint64_t m_nCulled;
 };
 
-WifiApp::WifiApp ()
+NS_OBJECT_ENSURE_REGISTERED (RangeCulledPropagationLossModel);
+
+TypeId
+RangeCulledPropagationLossModel::GetTypeId (void)
 {
+  static TypeId tid = TypeId ("ns3::RangeCulledPropagationLossModel")
+    .SetParent<PropagationLossModel> ()
+    .AddConstructor<RangeCulledPropagationLossModel> ()
+    .AddAttribute ("CulledRxPower",
+                   "The receive power (dBm) reported for receivers out of range",
+                   DoubleValue (-1000.0),
+                   MakeDoubleAccessor (&RangeCulledPropagationLossModel::m_culledRxPowerDbm),
+                   MakeDoubleChecker<double> ());
+  return tid;
 }
 
-WifiApp::~WifiApp ()
+RangeCulledPropagationLossModel::RangeCulledPropagationLossModel ()
+  : m_maxRange (0),
+    m_maxRangeSquared (0),
+    m_culledRxPowerDbm (-1000.0),
+    m_nEvaluated (0),
+    m_nCulled (0)
 {
 }
 
 void
-WifiApp::Simulate (int argc, char **argv)
-{
-  // Simulator Program Flow:
-  // (source:  NS-3 Annual Meeting, May, 2014, session 2 slides 6, 28)
-  //   (HandleProgramInputs:)
-  //   SetDefaultAttributeValues
-  //   ParseCommandLineArguments
-  //   (ConfigureTopology:)
-  //   ConfigureNodes
-  //   ConfigureChannels
-  //   ConfigureDevices
-  //   ConfigureMobility
-  //   ConfigureApplications
-  //     e.g AddInternetStackToNodes
-  //         ConfigureIpAddressingAndRouting
-  //         configureSendMessages
-  //   ConfigureTracing
-  //   RunSimulation
-  //   ProcessOutputs
-
-  SetDefaultAttributeValues ();
-  ParseCommandLineArguments (argc, argv);
-  ConfigureNodes ();
-  ConfigureChannels ();
-  ConfigureDevices ();
-  ConfigureMobility ();
-  ConfigureApplications ();
-  ConfigureTracing ();
-  RunSimulation ();
-  ProcessOutputs ();
-}
-
-void
-WifiApp::SetDefaultAttributeValues ()
-{
-}
-
-void
-WifiApp::ParseCommandLineArguments (int argc, char **argv)
+RangeCulledPropagationLossModel::SetInner (Ptr<PropagationLossModel> inner)
 {
+  m_inner = inner;
 }
 
-void
-WifiApp::ConfigureNodes ()
-{
-}
-
-void
-WifiApp::ConfigureChannels ()
-{
-}
-
-void
-WifiApp::ConfigureDevices ()
+double
+RangeCulledPropagationLossModel::SetLinkBudget (double txPowerDbm, double floorDbm)
 {
+  NS_ASSERT (m_inner != 0);
+  // all supported models lose power monotonically with distance, so
+  // bracket the floor crossing by doubling and then bisect
+  Ptr<ConstantPositionMobilityModel> a = CreateObject<ConstantPositionMobilityModel> ();
+  Ptr<ConstantPositionMobilityModel> b = CreateObject<ConstantPositionMobilityModel> ();
+  a->SetPosition (Vector (0, 0, 0));
+  double low = 0;
+  double high = 1.0;
+  const double limit = 1e7;
+  for (;;)
+    {
+      b->SetPosition (Vector (high, 0, 0));
+      if (m_inner->CalcRxPower (txPowerDbm, a, b) < floorDbm || high >= limit)
+        {
+          break;
+        }
+      low = high;
+      high *= 2;
+    }
+  while (high - low > 1.0)
+    {
+      double mid = (low + high) / 2;
+      b->SetPosition (Vector (mid, 0, 0));
+      if (m_inner->CalcRxPower (txPowerDbm, a, b) < floorDbm)
+        {
+          high = mid;
+        }
+      else
+        {
+          low = mid;
+        }
+    }
+  m_maxRange = high;
+  m_maxRangeSquared = high * high;
+  return m_maxRange;
 }
 
-void
-WifiApp::ConfigureMobility ()
+double
+RangeCulledPropagationLossModel::GetMaxRange () const
 {
+  return m_maxRange;
 }
 
-void
-WifiApp::ConfigureApplications ()
+uint64_t
+RangeCulledPropagationLossModel::GetNEvaluated () const
 {
+  return m_nEvaluated;
 }
 
-void
-WifiApp::ConfigureTracing ()
+uint64_t
+RangeCulledPropagationLossModel::GetNCulled () const
 {
+  return m_nCulled;
 }
 
-void
-WifiApp::RunSimulation ()
+double
+RangeCulledPropagationLossModel::DoCalcRxPower (double txPowerDbm,
+                                                Ptr<MobilityModel> a,
+                                                Ptr<MobilityModel> b) const
 {
+  Vector pa = a->GetPosition ();
+  Vector pb = b->GetPosition ();
+  double dx = pa.x - pb.x;
+  double dy = pa.y - pb.y;
+  double dz = pa.z - pb.z;
+  if (m_maxRangeSquared > 0 && dx * dx + dy * dy + dz * dz > m_maxRangeSquared)
+    {
+      m_nCulled++;
+      return m_culledRxPowerDbm;
+    }
+  m_nEvaluated++;
+  return m_inner->CalcRxPower (txPowerDbm, a, b);
 }
 
-void
-WifiApp::ProcessOutputs ()
+int64_t
+RangeCulledPropagationLossModel::DoAssignStreams (int64_t stream)
 {
+  return m_inner->AssignStreams (stream);
 }
 
-class Experiment : public WifiApp
+/**
+ * \brief Memoizes the wrapped propagation loss for links with a
+ * stationary end.
+ *
+ * Links between a ConstantPositionMobilityModel and a mobile node are
+ * cached per stationary model and horizontal cell of the mobile node,
+ * and answered with the loss towards the center of the cell, so every
+ * position in a cell gets the same loss whatever was seen first.  The
+ * height of the mobile node is kept exact.  Links between two
+ * stationary models are kept in a table that can be filled up front.
+ * Mobile-to-mobile links are always computed.  Only deterministic
+ * models (no fading) should be wrapped.
+ */
+class CachedPropagationLossModel : public PropagationLossModel
 {
 public:
+  /**
+   * \brief Get class TypeId
+   * \return the TypeId for the class
+   */
+  static TypeId GetTypeId (void);
+
   /**
    * \brief Constructor
    * \return none
    */
-  Experiment ();
-
-  ~Experiment();
+  CachedPropagationLossModel ();
 
-protected:
   /**
-   * \brief Sets default attribute values
+   * \brief Sets the model whose loss is cached
+   * \param inner the wrapped propagation loss model
    * \return none
    */
-  virtual void SetDefaultAttributeValues ();
+  void SetInner (Ptr<PropagationLossModel> inner);
 
   /**
-   * \brief Process command line arguments
-   * \param argc program arguments count
-   * \param argv program arguments
+   * \brief Fills the table of links between stationary nodes
+   * \param c node container
    * \return none
    */
-  virtual void ParseCommandLineArguments (int argc, char **argv);
+  void PrecomputeStaticLinks (NodeContainer & c);
 
   /**
-   * \brief Configure nodes
-   * \return none
+   * \brief Returns the number of lookups answered from a cache
+   * \return the number of hits
    */
-  virtual void ConfigureNodes ();
+  uint64_t GetNHits () const;
 
   /**
-   * \brief Configure channels
-   * \return none
+   * \brief Returns the number of lookups computed by the wrapped model
+   * \return the number of misses, including mobile-to-mobile links
    */
-  virtual void ConfigureChannels ();
+  uint64_t GetNMisses () const;
 
   /**
-   * \brief Configure devices
-   * \return none
+   * \brief Returns the number of cached links
+   * \return the number of entries in both caches
    */
-  virtual void ConfigureDevices ();
+  uint32_t GetNEntries () const;
+
+private:
+  virtual double DoCalcRxPower (double txPowerDbm,
+                                Ptr<MobilityModel> a,
+                                Ptr<MobilityModel> b) const;
+  virtual int64_t DoAssignStreams (int64_t stream);
 
   /**
-   * \brief Configure mobility
-   * \return none
+   * \brief Key of a stationary-to-mobile link
    */
-  virtual void ConfigureMobility ();
+  struct MobileKey
+  {
+    const MobilityModel *stationary;
+    int64_t x;
+    int64_t y;
+    double z;
+    bool stationaryIsSender;
+    bool operator== (const MobileKey & o) const;
+  };
 
   /**
-   * \brief Configure applications
-   * \return none
+   * \brief Hashes a MobileKey
    */
-  virtual void ConfigureApplications ();
+  struct MobileKeyHash
+  {
+    size_t operator() (const MobileKey & k) const;
+  };
 
   /**
-   * \brief Configure tracing
-   * \return none
+   * \brief Key of a stationary-to-stationary link
    */
-  virtual void ConfigureTracing ();
+  typedef std::pair<const MobilityModel *, const MobilityModel *> StaticKey;
 
   /**
-   * \brief Run the simulation
-   * \return none
+   * \brief Hashes a StaticKey
    */
-  virtual void RunSimulation ();
+  struct StaticKeyHash
+  {
+    size_t operator() (const StaticKey & k) const;
+  };
 
   /**
-   * \brief Process outputs
-   * \return none
+   * \brief Cached loss, valid while the stationary ends stay put
    */
-  virtual void ProcessOutputs ();
+  struct Entry
+  {
+    double lossDb;
+    Vector a;
+    Vector b;
+  };
 
-private:
   /**
-   * \brief Run the simulation
-   * \return none
+   * \brief Quantizes a coordinate to the cache resolution
+   * \param v the coordinate
+   * \return the cell index
    */
-  void Run ();
+  int64_t Quantize (double v) const;
 
   /**
-   * \brief Run the simulation
-   * \return none
+   * \brief Checks whether a mobility model is a stationary one; a
+   * TypeId comparison, cheaper than a DynamicCast
+   * \param m the mobility model
+   * \return true for a ConstantPositionMobilityModel
    */
-  void CommandSetup (int argc, char **argv);
+  static bool IsStationary (const Ptr<MobilityModel> & m);
 
   /**
-   * \brief Checks the throughput and outputs summary to CSV file1.
-   * This is scheduled and called once per second
-   * \return none
+   * \brief Checks whether a stationary end is still where it was cached
+   * \param cached the cached position
+   * \param current the current position
+   * \return true if both positions are equal
    */
-  void CheckThroughput ();
+  static bool SamePosition (const Vector & cached, const Vector & current);
+
+  Ptr<PropagationLossModel> m_inner;
+  double m_resolution;    // meters
+  uint32_t m_maxEntries;
+  Ptr<ConstantPositionMobilityModel> m_cellCenter;
+  mutable std::unordered_map<MobileKey, Entry, MobileKeyHash> m_mobileCache;
+  mutable std::unordered_map<StaticKey, Entry, StaticKeyHash> m_staticTable;
+  mutable uint64_t m_nHits;
+  mutable uint64_t m_nMisses;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (CachedPropagationLossModel);
+
+TypeId
+CachedPropagationLossModel::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::CachedPropagationLossModel")
+    .SetParent<PropagationLossModel> ()
+    .AddConstructor<CachedPropagationLossModel> ()
+    .AddAttribute ("Resolution",
+                   "Grid (m) mobile positions are quantized to",
+                   DoubleValue (1.0),
+                   MakeDoubleAccessor (&CachedPropagationLossModel::m_resolution),
+                   MakeDoubleChecker<double> (0.001))
+    .AddAttribute ("MaxEntries",
+                   "Size at which the mobile link cache is flushed",
+                   UintegerValue (1 << 20),
+                   MakeUintegerAccessor (&CachedPropagationLossModel::m_maxEntries),
+                   MakeUintegerChecker<uint32_t> ());
+  return tid;
+}
+
+CachedPropagationLossModel::CachedPropagationLossModel ()
+  : m_resolution (1.0),
+    m_maxEntries (1 << 20),
+    m_cellCenter (CreateObject<ConstantPositionMobilityModel> ()),
+    m_nHits (0),
+    m_nMisses (0)
+{
+}
+
+bool
+CachedPropagationLossModel::MobileKey::operator== (const MobileKey & o) const
+{
+  return stationary == o.stationary && x == o.x && y == o.y && z == o.z
+         && stationaryIsSender == o.stationaryIsSender;
+}
+
+size_t
+CachedPropagationLossModel::MobileKeyHash::operator() (const MobileKey & k) const
+{
+  uint64_t h = reinterpret_cast<uintptr_t> (k.stationary);
+  h = h * 0x9e3779b97f4a7c15ULL + static_cast<uint64_t> (k.x);
+  h = h * 0x9e3779b97f4a7c15ULL + static_cast<uint64_t> (k.y);
+  h = h * 0x9e3779b97f4a7c15ULL + std::hash<double> () (k.z);
+  h = h * 0x9e3779b97f4a7c15ULL + k.stationaryIsSender;
+  return h ^ (h >> 32);
+}
+
+size_t
+CachedPropagationLossModel::StaticKeyHash::operator() (const StaticKey & k) const
+{
+  uint64_t h = reinterpret_cast<uintptr_t> (k.first);
+  h = h * 0x9e3779b97f4a7c15ULL + reinterpret_cast<uintptr_t> (k.second);
+  return h ^ (h >> 32);
+}
+
+void
+CachedPropagationLossModel::SetInner (Ptr<PropagationLossModel> inner)
+{
+  m_inner = inner;
+}
+
+int64_t
+CachedPropagationLossModel::Quantize (double v) const
+{
+  return static_cast<int64_t> (std::floor (v / m_resolution));
+}
+
+bool
+CachedPropagationLossModel::IsStationary (const Ptr<MobilityModel> & m)
+{
+  static const TypeId stationary = ConstantPositionMobilityModel::GetTypeId ();
+  return m->GetInstanceTypeId () == stationary;
+}
+
+bool
+CachedPropagationLossModel::SamePosition (const Vector & cached, const Vector & current)
+{
+  return cached.x == current.x && cached.y == current.y && cached.z == current.z;
+}
+
+void
+CachedPropagationLossModel::PrecomputeStaticLinks (NodeContainer & c)
+{
+  std::vector<Ptr<MobilityModel> > stationary;
+  for (uint32_t i = 0; i < c.GetN (); i++)
+    {
+      Ptr<MobilityModel> mobility = c.Get (i)->GetObject<MobilityModel> ();
+      if (IsStationary (mobility))
+        {
+          stationary.push_back (mobility);
+        }
+    }
+  for (uint32_t i = 0; i < stationary.size (); i++)
+    {
+      for (uint32_t j = 0; j < stationary.size (); j++)
+        {
+          if (i != j)
+            {
+              Entry e;
+              e.lossDb = -m_inner->CalcRxPower (0, stationary[i], stationary[j]);
+              e.a = stationary[i]->GetPosition ();
+              e.b = stationary[j]->GetPosition ();
+              m_staticTable[StaticKey (PeekPointer (stationary[i]), PeekPointer (stationary[j]))] = e;
+            }
+        }
+    }
+}
+
+uint64_t
+CachedPropagationLossModel::GetNHits () const
+{
+  return m_nHits;
+}
+
+uint64_t
+CachedPropagationLossModel::GetNMisses () const
+{
+  return m_nMisses;
+}
+
+uint32_t
+CachedPropagationLossModel::GetNEntries () const
+{
+  return m_mobileCache.size () + m_staticTable.size ();
+}
+
+double
+CachedPropagationLossModel::DoCalcRxPower (double txPowerDbm,
+                                           Ptr<MobilityModel> a,
+                                           Ptr<MobilityModel> b) const
+{
+  bool aStationary = IsStationary (a);
+  bool bStationary = IsStationary (b);
+  if (!aStationary && !bStationary)
+    {
+      m_nMisses++;
+      return m_inner->CalcRxPower (txPowerDbm, a, b);
+    }
+
+  Vector pa = a->GetPosition ();
+  Vector pb = b->GetPosition ();
+  if (aStationary && bStationary)
+    {
+      StaticKey key (PeekPointer (a), PeekPointer (b));
+      std::unordered_map<StaticKey, Entry, StaticKeyHash>::iterator it = m_staticTable.find (key);
+      if (it != m_staticTable.end () && SamePosition (it->second.a, pa)
+          && SamePosition (it->second.b, pb))
+        {
+          m_nHits++;
+          return txPowerDbm - it->second.lossDb;
+        }
+      m_nMisses++;
+      Entry & e = m_staticTable[key];
+      e.lossDb = -m_inner->CalcRxPower (0, a, b);
+      e.a = pa;
+      e.b = pb;
+      return txPowerDbm - e.lossDb;
+    }
+
+  // the stationary end is validated by position, the mobile end is
+  // answered for its whole quantization cell
+  Vector stationaryPos = aStationary ? pa : pb;
+  Vector mobilePos = aStationary ? pb : pa;
+  MobileKey key;
+  key.stationary = aStationary ? PeekPointer (a) : PeekPointer (b);
+  key.x = Quantize (mobilePos.x);
+  key.y = Quantize (mobilePos.y);
+  key.z = mobilePos.z;
+  key.stationaryIsSender = aStationary;
+  std::unordered_map<MobileKey, Entry, MobileKeyHash>::iterator it = m_mobileCache.find (key);
+  if (it != m_mobileCache.end () && SamePosition (it->second.a, stationaryPos))
+    {
+      m_nHits++;
+      return txPowerDbm - it->second.lossDb;
+    }
+  m_nMisses++;
+  if (m_mobileCache.size () >= m_maxEntries)
+    {
+      m_mobileCache.clear ();
+    }
+  m_cellCenter->SetPosition (Vector ((key.x + 0.5) * m_resolution,
+                                     (key.y + 0.5) * m_resolution,
+                                     key.z));
+  Entry & e = m_mobileCache[key];
+  if (aStationary)
+    {
+      e.lossDb = -m_inner->CalcRxPower (0, a, m_cellCenter);
+    }
+  else
+    {
+      e.lossDb = -m_inner->CalcRxPower (0, m_cellCenter, b);
+    }
+  e.a = stationaryPos;
+  return txPowerDbm - e.lossDb;
+}
+
+int64_t
+CachedPropagationLossModel::DoAssignStreams (int64_t stream)
+{
+  return m_inner->AssignStreams (stream);
+}
 
+/**
+ * \brief Fixed-size binary record of one CourseChange event
+ */
+struct MobilityTraceRecord
+{
+  int64_t time;      // simulation time, in time steps
+  uint32_t nodeId;
+  uint32_t reserved;
+  double posX;
+  double posY;
+  double posZ;
+  double velX;
+  double velY;
+  double velZ;
+};
+
+/**
+ * \brief Logs CourseChange events as binary records.
+ *
+ * The simulation thread only copies a record into the current block
+ * of a ring of blocks; full blocks are written to disk by a background
+ * thread.  ConvertToText turns a trace back into the text format of
+ * Experiment's original CourseChange output.
+ */
+class MobilityTraceLogger
+{
+public:
   /**
-   * \brief Set up log file
+   * \brief Constructor
    * \return none
    */
-  void SetupLogFile ();
+  MobilityTraceLogger ();
 
   /**
-   * \brief Set up logging
+   * \brief Destructor; closes the trace if still open
    * \return none
    */
-  void SetupLogging ();
+  ~MobilityTraceLogger ();
 
   /**
-   * \brief Configure default attributes
-   * \return none
+   * \brief Opens the trace file and starts the writer thread
+   * \param fileName the binary trace file
+   * \return true if the file could be opened
    */
-  void ConfigureDefaults ();
+  bool Open (std::string fileName);
 
-  /**CommandLine cmd;
-   * \brief Set up the adhoc mobility nodes
+  /**
+   * \brief Flushes pending records, stops the writer and closes the file
    * \return none
    */
-//   void SetupAdhocMobilityNodes ();
+  void Close ();
 
   /**
-   * \brief Set up the adhoc devices
+   * \brief Records the current state of a mobility model
+   * \param mobility the mobility model whose course changed
    * \return none
    */
-//   void SetupAdhocDevices ();
+  void Record (Ptr<const MobilityModel> mobility);
 
   /**
-   * \brief Set up generation of IEEE 1609 WAVE messages,
-   * as a Basic Safety Message (BSM).  The BSM is typically
-   * a ~200-byte packets broadcast by all vehicles at a nominal
-   * rate of 10 Hz
-   * \return none
+   * \brief Returns the number of records written so far
+   * \return the number of records
    */
-//   void SetupWaveMessages ();
+  uint64_t GetNRecords ();
 
   /**
-   * \brief Set up generation of packets to be routed
-   * through the vehicular network
-   * \return none
+   * \brief Returns how often the simulation thread had to wait for the writer
+   * \return the number of stalls
    */
-  void SetupRoutingMessages ();
+  uint64_t GetNStalls ();
 
   /**
-   * \brief Set up a prescribed scenario
-   * \return none
+   * \brief Converts a binary trace to the text CourseChange format
+   * \param binFileName the binary trace file
+   * \param textFileName the text output file
+   * \return true on success
    */
-  void SetupScenario ();
+  static bool ConvertToText (std::string binFileName, std::string textFileName);
 
+private:
   /**
-   * \brief Write the header line to the CSV file1
+   * \brief Hands the current block to the writer thread, waiting for
+   * a free block if the ring is full
    * \return none
    */
-  void WriteCsvHeader ();
+  void Submit ();
 
   /**
-   * \brief Set up configuration parameter from the global variables
+   * \brief Writer thread body
    * \return none
    */
-//   void SetConfigFromGlobals ();
+  void Drain ();
+
+  static const uint32_t BLOCK_RECORDS = 4096;
+  static const uint32_t N_BLOCKS = 8;
+
+  std::vector<MobilityTraceRecord> m_ring; // N_BLOCKS * BLOCK_RECORDS records
+  uint32_t m_fillBlock;                    // block being filled (simulation thread)
+  uint32_t m_fillPos;                      // next record in m_fillBlock
+  uint32_t m_drainBlock;                   // next block to write (writer thread)
+  uint32_t m_pending;                      // full blocks not yet written
+  bool m_closing;
+  uint64_t m_nRecords;
+  uint64_t m_nStalls;
+  FILE *m_file;
+  SystemMutex m_mutex;                     // guards m_drainBlock, m_pending, m_closing
+  SystemCondition m_filled;
+  SystemCondition m_drained;
+  Ptr<SystemThread> m_writer;
+};
 
-//   /**
-//    * \brief Set up the global variables from the configuration parameters
-//    * \return none
-//    */
-//   void SetGlobalsFromConfig ();
+static const char g_mobilityTraceMagic[8] = { 'M', 'O', 'B', 'T', 'R', 'A', 'C', 'E' };
+
+MobilityTraceLogger::MobilityTraceLogger ()
+  : m_fillBlock (0),
+    m_fillPos (0),
+    m_drainBlock (0),
+    m_pending (0),
+    m_closing (false),
+    m_nRecords (0),
+    m_nStalls (0),
+    m_file (NULL)
+{
+}
 
-  static void
-  CourseChange (std::ostream *os, std::string foo, Ptr<const MobilityModel> mobility);
+MobilityTraceLogger::~MobilityTraceLogger ()
+{
+  Close ();
+}
 
-  uint32_t m_port;
-  std::string m_CSVfileName;
-  std::string m_CSVfileName2;
-  uint32_t m_nSinks;
-  std::string m_protocolName;
-  double m_txp;
-  bool m_traceMobility;
-  uint32_t m_protocol;
+bool
+MobilityTraceLogger::Open (std::string fileName)
+{
+  NS_ASSERT (m_file == NULL);
+  m_file = std::fopen (fileName.c_str (), "wb");
+  if (m_file == NULL)
+    {
+      NS_LOG_ERROR ("Unable to open mobility trace " << fileName);
+      return false;
+    }
+  uint32_t recordSize = sizeof (MobilityTraceRecord);
+  std::fwrite (g_mobilityTraceMagic, sizeof (g_mobilityTraceMagic), 1, m_file);
+  std::fwrite (&recordSize, sizeof (recordSize), 1, m_file);
+
+  m_ring.resize (N_BLOCKS * BLOCK_RECORDS);
+  m_fillBlock = m_fillPos = m_drainBlock = m_pending = 0;
+  m_closing = false;
+  m_writer = Create<SystemThread> (MakeCallback (&MobilityTraceLogger::Drain, this));
+  m_writer->Start ();
+  return true;
+}
 
-  uint32_t m_lossModel;
-  uint32_t m_fading;
-  std::string m_lossModelName;
+void
+MobilityTraceLogger::Close ()
+{
+  if (m_file == NULL)
+    {
+      return;
+    }
+  if (m_fillPos > 0)
+    {
+      Submit ();
+    }
+  m_mutex.Lock ();
+  m_closing = true;
+  m_mutex.Unlock ();
+  m_filled.SetCondition (true);
+  m_filled.Signal ();
+  m_writer->Join ();
+  m_writer = 0;
+  std::fclose (m_file);
+  m_file = NULL;
+}
 
-  std::string m_logFile;
-  uint32_t m_mobility;
+void
+MobilityTraceLogger::Record (Ptr<const MobilityModel> mobility)
+{
+  MobilityTraceRecord & r = m_ring[m_fillBlock * BLOCK_RECORDS + m_fillPos];
+  Vector pos = mobility->GetPosition ();
+  Vector vel = mobility->GetVelocity ();
+  r.time = Simulator::Now ().GetTimeStep ();
+  r.nodeId = mobility->GetObject<Node> ()->GetId ();
+  r.reserved = 0;
+  r.posX = pos.x;
+  r.posY = pos.y;
+  r.posZ = pos.z;
+  r.velX = vel.x;
+  r.velY = vel.y;
+  r.velZ = vel.z;
+  if (++m_fillPos == BLOCK_RECORDS)
+    {
+      Submit ();
+    }
+}
+
+void
+MobilityTraceLogger::Submit ()
+{
+  m_mutex.Lock ();
+  // records of a partial (final) block are written as they are
+  m_nRecords += m_fillPos;
+  m_pending++;
+  if (m_pending == N_BLOCKS)
+    {
+      m_nStalls++;
+    }
+  while (m_pending == N_BLOCKS)
+    {
+      // TimedWait does not clear the condition; clearing it while
+      // m_pending is known full means only a later Drain sets it
+      m_drained.SetCondition (false);
+      m_mutex.Unlock ();
+      m_filled.SetCondition (true);
+      m_filled.Signal ();
+      m_drained.TimedWait (1000000000);
+      m_mutex.Lock ();
+    }
+  m_mutex.Unlock ();
+  m_filled.SetCondition (true);
+  m_filled.Signal ();
+  m_fillBlock = (m_fillBlock + 1) % N_BLOCKS;
+  m_fillPos = 0;
+}
+
+void
+MobilityTraceLogger::Drain ()
+{
+  // the final block may be partial; its size is derived from m_nRecords
+  uint64_t written = 0;
+  for (;;)
+    {
+      m_mutex.Lock ();
+      // cleared before m_pending is read, so a Submit after the read
+      // sets it again and TimedWait returns at once
+      m_filled.SetCondition (false);
+      bool closing = m_closing;
+      uint32_t pending = m_pending;
+      uint64_t submitted = m_nRecords;
+      m_mutex.Unlock ();
+
+      if (pending == 0)
+        {
+          if (closing)
+            {
+              break;
+            }
+          m_filled.TimedWait (1000000000);
+          continue;
+        }
+
+      uint64_t count = submitted - written;
+      if (count > BLOCK_RECORDS)
+        {
+          count = BLOCK_RECORDS;
+        }
+      std::fwrite (&m_ring[m_drainBlock * BLOCK_RECORDS], sizeof (MobilityTraceRecord), count, m_file);
+      written += count;
+
+      m_mutex.Lock ();
+      m_drainBlock = (m_drainBlock + 1) % N_BLOCKS;
+      m_pending--;
+      m_mutex.Unlock ();
+      m_drained.SetCondition (true);
+      m_drained.Signal ();
+    }
+  std::fflush (m_file);
+}
+
+uint64_t
+MobilityTraceLogger::GetNRecords ()
+{
+  CriticalSection cs (m_mutex);
+  return m_nRecords;
+}
+
+uint64_t
+MobilityTraceLogger::GetNStalls ()
+{
+  return m_nStalls;
+}
+
+bool
+MobilityTraceLogger::ConvertToText (std::string binFileName, std::string textFileName)
+{
+  FILE *in = std::fopen (binFileName.c_str (), "rb");
+  if (in == NULL)
+    {
+      NS_LOG_ERROR ("Unable to open mobility trace " << binFileName);
+      return false;
+    }
+  char magic[sizeof (g_mobilityTraceMagic)];
+  uint32_t recordSize = 0;
+  if (std::fread (magic, sizeof (magic), 1, in) != 1
+      || std::fread (&recordSize, sizeof (recordSize), 1, in) != 1
+      || std::memcmp (magic, g_mobilityTraceMagic, sizeof (magic)) != 0
+      || recordSize != sizeof (MobilityTraceRecord))
+    {
+      NS_LOG_ERROR (binFileName << " is not a mobility trace");
+      std::fclose (in);
+      return false;
+    }
+
+  std::ofstream os (textFileName.c_str ());
+  MobilityTraceRecord r;
+  while (std::fread (&r, sizeof (r), 1, in) == 1)
+    {
+      // same format as the former per-event text output
+      os << TimeStep (r.time) << " POS: x=" << r.posX << ", y=" << r.posY
+         << "; VEL:" << r.velX << ", y=" << r.velY << "\n";
+    }
+  std::fclose (in);
+  return true;
+}
+
+/**
+ * \brief One straight-line piece of a precomputed trajectory; a pause
+ * is a segment with zero velocity
+ */
+struct WaypointSegment
+{
+  double start;    // s
+  double x, y, z;  // position at start
+  double vx, vy, vz;
+};
+
+/**
+ * \brief Precomputed random waypoint trajectories, memory-mapped.
+ *
+ * File layout: the magic, the generation Parameters, nodes + 1
+ * segment offsets, then the segments of every node sorted by start
+ * time.  A node's last
+ * segment lasts forever.  Each file is mapped once and shared by the
+ * replay models of all nodes.
+ */
+class WaypointTrace : public SimpleRefCount<WaypointTrace>
+{
+public:
+  /**
+   * \brief Parameters of a generated trace
+   */
+  struct Parameters
+  {
+    uint32_t nNodes;
+    double duration;   // s
+    double minSpeed;   // m/s
+    double maxSpeed;   // m/s
+    double pause;      // s
+    double minX, maxX; // m
+    double minY, maxY; // m
+    int64_t stream;
+  };
+
+  /**
+   * \brief Generates random waypoint trajectories with the
+   * distributions RandomWaypointMobilityModel draws from
+   * \param fileName the trace file
+   * \param parameters the scenario
+   * \return true on success
+   */
+  static bool Generate (std::string fileName, const Parameters & parameters);
+
+  /**
+   * \brief Maps a trace file, or returns the mapping already open
+   * \param fileName the trace file
+   * \return the trace, or 0 if it cannot be read
+   */
+  static Ptr<WaypointTrace> Open (std::string fileName);
+
+  /**
+   * \brief Checks whether a trace generated with stored serves a run
+   * with wanted
+   * \param stored the parameters of the trace
+   * \param wanted the parameters of the run
+   * \return true if the trace covers the run
+   */
+  static bool Matches (const Parameters & stored, const Parameters & wanted);
+
+  /**
+   * \brief Returns a file name identifying the parameters
+   * \param prefix the name prefix
+   * \param parameters the scenario
+   * \return the file name
+   */
+  static std::string DefaultFileName (std::string prefix, const Parameters & parameters);
+
+  /**
+   * \brief Constructor; use Open
+   * \return none
+   */
+  WaypointTrace ();
+
+  /**
+   * \brief Unmaps the file
+   * \return none
+   */
+  ~WaypointTrace ();
+
+  /**
+   * \brief Returns the parameters the trace was generated with
+   * \return the parameters
+   */
+  const Parameters & GetParameters () const;
+
+  /**
+   * \brief Returns the number of nodes
+   * \return the number of nodes
+   */
+  uint32_t GetNNodes () const;
+
+  /**
+   * \brief Returns the first segment of a node
+   * \param node the node index in the trace
+   * \return the first segment
+   */
+  const WaypointSegment * Begin (uint32_t node) const;
+
+  /**
+   * \brief Returns the end of the segments of a node
+   * \param node the node index in the trace
+   * \return one past the last segment
+   */
+  const WaypointSegment * End (uint32_t node) const;
+
+private:
+  void *m_map;
+  size_t m_size;
+  Parameters m_parameters;
   uint32_t m_nNodes;
-  uint32_t m_nBase; //no of Base stations
-  double m_TotalSimTime;
-  std::string m_rate;
-  std::string m_trName;
-  int m_nodeSpeed; //in m/s
-  int m_nodePause; //in s
-  int m_verbose;
-  std::ofstream m_os;
-  NetDeviceContainer m_TxDevices;
-  NetDeviceContainer m_baseDevices;
-  NetDeviceContainer m_allDevices;
-  Ipv4InterfaceContainer m_TxInterfaces;
-  Ipv4InterfaceContainer m_baseInterfaces;
-  Ipv4InterfaceContainer m_allInterfaces;
-  uint32_t m_macMode;
-  int m_routingTables;
-  int m_asciiTrace;
-  int m_pcap;
-  double m_freq; //0 5.8Ghz 1 2.4Ghz
-  double m_baseAntennaHeight; //Base station Height 
-  double m_baseAntennaGain;
-  double m_nodeAntennaGain;
-  double m_nodeAntennaHeight;
- 
-  Ptr<RoutingHelper> m_routingHelper;
-  Ptr<FlowMonitor> m_monitor;
-  int m_log;
-  // used to get consistent random numbers across scenarios
-  int64_t m_streamIndex;
-  NodeContainer m_TxNodes;
-  NodeContainer m_baseNodes;
-  NodeContainer m_allNodes;
-  std::string m_exp;
-  int m_cumulativeCaptureStart;
-  FlowMonitorHelper m_flowmon;
+  const uint64_t *m_offsets;
+  const WaypointSegment *m_segments;
+
+  static std::map<std::string, WaypointTrace *> g_open;
 };
 
-Experiment::Experiment()
-  : m_port (9),
-    m_CSVfileName ("experiment.output.csv"),
-    m_CSVfileName2 ("experiment.output2.csv"),
-    m_nSinks (5),
-    m_protocolName ("protocol"),
-    m_traceMobility (false),
-    // Differnt Routing Protocls
-    m_protocol (2),
-    // Different Loss models
-    m_lossModel (1),
-    m_fading (0),
-    m_lossModelName (""),
-    m_logFile ("low_ct-unterstrass-1day.filt.5.adj.log"),
-    m_mobility (2),
-    m_nNodes (10),
-    m_nBase(1),
-    m_TotalSimTime (300),
-    //OnoffApplication frequency
-    m_rate ("2048bps"),
-    m_trName ("experiment-compare"),
-    m_nodeSpeed (50),
-    m_nodePause (0),
-    m_verbose (0),
-    m_macMode (0),
-    m_routingTables (0),
-    m_asciiTrace (0),
-    m_pcap (0),
-    m_log (1),
-    m_streamIndex (0),
-    m_TxNodes (),
-    m_exp (""),
-    m_cumulativeCaptureStart (0),
-    m_freq(5.8e9),
-    m_baseAntennaHeight(50),
-    m_nodeAntennaHeight(9),
-    m_baseAntennaGain(18.6),
-    m_nodeAntennaGain(14.6),
-    m_allNodes()
-    
+static const char g_waypointTraceMagic[8] = { 'W', 'A', 'Y', 'P', 'O', 'I', 'N', 'T' };
+
+std::map<std::string, WaypointTrace *> WaypointTrace::g_open;
+
+WaypointTrace::WaypointTrace ()
+  : m_map (MAP_FAILED),
+    m_size (0),
+    m_nNodes (0),
+    m_offsets (NULL),
+    m_segments (NULL)
+{
+}
+
+WaypointTrace::~WaypointTrace ()
+{
+  for (std::map<std::string, WaypointTrace *>::iterator i = g_open.begin (); i != g_open.end (); ++i)
+    {
+      if (i->second == this)
+        {
+          g_open.erase (i);
+          break;
+        }
+    }
+  if (m_map != MAP_FAILED)
+    {
+      munmap (m_map, m_size);
+    }
+}
+
+bool
+WaypointTrace::Generate (std::string fileName, const Parameters & parameters)
+{
+  Ptr<UniformRandomVariable> x = CreateObject<UniformRandomVariable> ();
+  x->SetAttribute ("Min", DoubleValue (parameters.minX));
+  x->SetAttribute ("Max", DoubleValue (parameters.maxX));
+  x->SetStream (parameters.stream);
+  Ptr<UniformRandomVariable> y = CreateObject<UniformRandomVariable> ();
+  y->SetAttribute ("Min", DoubleValue (parameters.minY));
+  y->SetAttribute ("Max", DoubleValue (parameters.maxY));
+  y->SetStream (parameters.stream + 1);
+  Ptr<UniformRandomVariable> speed = CreateObject<UniformRandomVariable> ();
+  speed->SetAttribute ("Min", DoubleValue (parameters.minSpeed));
+  speed->SetAttribute ("Max", DoubleValue (parameters.maxSpeed));
+  speed->SetStream (parameters.stream + 2);
+
+  std::vector<uint64_t> offsets (1, 0);
+  std::vector<WaypointSegment> segments;
+  for (uint32_t node = 0; node < parameters.nNodes; node++)
+    {
+      double t = 0;
+      double px = x->GetValue ();
+      double py = y->GetValue ();
+      while (true)
+        {
+          double tx = x->GetValue ();
+          double ty = y->GetValue ();
+          double v = speed->GetValue ();
+          double distance = std::sqrt ((tx - px) * (tx - px) + (ty - py) * (ty - py));
+          WaypointSegment move;
+          move.start = t;
+          move.x = px;
+          move.y = py;
+          move.z = 0;
+          move.vx = (v > 0 && distance > 0) ? v * (tx - px) / distance : 0;
+          move.vy = (v > 0 && distance > 0) ? v * (ty - py) / distance : 0;
+          move.vz = 0;
+          segments.push_back (move);
+          if (t >= parameters.duration || v <= 0)
+            {
+              break;
+            }
+          t += distance / v;
+          px = tx;
+          py = ty;
+
+          WaypointSegment pause;
+          pause.start = t;
+          pause.x = px;
+          pause.y = py;
+          pause.z = 0;
+          pause.vx = pause.vy = pause.vz = 0;
+          segments.push_back (pause);
+          t += parameters.pause;
+          if (t >= parameters.duration)
+            {
+              break;
+            }
+        }
+      offsets.push_back (segments.size ());
+    }
+
+  // written aside and renamed, so concurrent runs never map a partial file
+  std::ostringstream partial;
+  partial << fileName << ".tmp" << getpid ();
+  FILE *out = std::fopen (partial.str ().c_str (), "wb");
+  if (out == NULL)
+    {
+      NS_LOG_ERROR ("Unable to create waypoint trace " << fileName);
+      return false;
+    }
+  std::fwrite (g_waypointTraceMagic, sizeof (g_waypointTraceMagic), 1, out);
+  std::fwrite (&parameters, sizeof (parameters), 1, out);
+  std::fwrite (&offsets[0], sizeof (uint64_t), offsets.size (), out);
+  if (!segments.empty ())
+    {
+      std::fwrite (&segments[0], sizeof (WaypointSegment), segments.size (), out);
+    }
+  bool ok = std::ferror (out) == 0;
+  ok = std::fclose (out) == 0 && ok;
+  if (!ok || std::rename (partial.str ().c_str (), fileName.c_str ()) != 0)
+    {
+      std::remove (partial.str ().c_str ());
+      return false;
+    }
+  return true;
+}
+
+Ptr<WaypointTrace>
+WaypointTrace::Open (std::string fileName)
+{
+  std::map<std::string, WaypointTrace *>::iterator it = g_open.find (fileName);
+  if (it != g_open.end ())
+    {
+      return it->second;
+    }
+
+  int fd = open (fileName.c_str (), O_RDONLY);
+  if (fd < 0)
+    {
+      return 0;
+    }
+  struct stat st;
+  if (fstat (fd, &st) != 0 || st.st_size < (off_t) (sizeof (g_waypointTraceMagic) + sizeof (Parameters)))
+    {
+      close (fd);
+      return 0;
+    }
+  Ptr<WaypointTrace> trace = Create<WaypointTrace> ();
+  trace->m_size = st.st_size;
+  trace->m_map = mmap (NULL, trace->m_size, PROT_READ, MAP_SHARED, fd, 0);
+  close (fd);
+  if (trace->m_map == MAP_FAILED)
+    {
+      return 0;
+    }
+
+  const char *base = static_cast<const char *> (trace->m_map);
+  if (std::memcmp (base, g_waypointTraceMagic, sizeof (g_waypointTraceMagic)) != 0)
+    {
+      NS_LOG_ERROR (fileName << " is not a waypoint trace");
+      return 0;
+    }
+  std::memcpy (&trace->m_parameters, base + sizeof (g_waypointTraceMagic), sizeof (Parameters));
+  trace->m_nNodes = trace->m_parameters.nNodes;
+  trace->m_offsets = reinterpret_cast<const uint64_t *> (base + sizeof (g_waypointTraceMagic) + sizeof (Parameters));
+  size_t header = sizeof (g_waypointTraceMagic) + sizeof (Parameters) + (trace->m_nNodes + 1) * sizeof (uint64_t);
+  trace->m_segments = reinterpret_cast<const WaypointSegment *> (trace->m_offsets + trace->m_nNodes + 1);
+  if (header > trace->m_size
+      || header + trace->m_offsets[trace->m_nNodes] * sizeof (WaypointSegment) != trace->m_size)
+    {
+      NS_LOG_ERROR (fileName << " is truncated");
+      return 0;
+    }
+
+  g_open[fileName] = PeekPointer (trace);
+  return trace;
+}
+
+bool
+WaypointTrace::Matches (const Parameters & stored, const Parameters & wanted)
+{
+  return stored.nNodes == wanted.nNodes && stored.duration >= wanted.duration
+         && stored.minSpeed == wanted.minSpeed && stored.maxSpeed == wanted.maxSpeed
+         && stored.pause == wanted.pause && stored.minX == wanted.minX && stored.maxX == wanted.maxX
+         && stored.minY == wanted.minY && stored.maxY == wanted.maxY && stored.stream == wanted.stream;
+}
+
+std::string
+WaypointTrace::DefaultFileName (std::string prefix, const Parameters & parameters)
+{
+  std::ostringstream name;
+  name << prefix << ".n" << parameters.nNodes << "-t" << parameters.duration
+       << "-v" << parameters.minSpeed << "-" << parameters.maxSpeed << "-p" << parameters.pause
+       << "-x" << parameters.minX << "-" << parameters.maxX << "-y" << parameters.minY << "-" << parameters.maxY
+       << "-s" << parameters.stream << ".waypoints.bin";
+  return name.str ();
+}
+
+const WaypointTrace::Parameters &
+WaypointTrace::GetParameters () const
+{
+  return m_parameters;
+}
+
+uint32_t
+WaypointTrace::GetNNodes () const
+{
+  return m_nNodes;
+}
+
+const WaypointSegment *
+WaypointTrace::Begin (uint32_t node) const
+{
+  return m_segments + m_offsets[node];
+}
+
+const WaypointSegment *
+WaypointTrace::End (uint32_t node) const
+{
+  return m_segments + m_offsets[node + 1];
+}
+
+/**
+ * \brief Segment ordering by start time, for the binary search
+ */
+static bool
+SegmentStartsAfter (double t, const WaypointSegment & segment)
+{
+  return t < segment.start;
+}
+
+/**
+ * \brief Mobility model replaying one node of a WaypointTrace.
+ *
+ * Positions are computed on demand from the segment covering the
+ * current time.  No events are scheduled unless EnableCourseChanges
+ * asks for a CourseChange at every segment start.  SetPosition is
+ * ignored.
+ */
+class ReplayMobilityModel : public MobilityModel
 {
+public:
+  /**
+   * \brief Get class TypeId
+   * \return the TypeId for the class
+   */
+  static TypeId GetTypeId (void);
+
+  /**
+   * \brief Constructor
+   * \return none
+   */
+  ReplayMobilityModel ();
+
+  /**
+   * \brief Selects the trajectory replayed
+   * \param trace the trace
+   * \param node the node index in the trace
+   * \return none
+   */
+  void SetTrace (Ptr<WaypointTrace> trace, uint32_t node);
+
+  /**
+   * \brief Notifies CourseChange at the start of every remaining
+   * segment, as RandomWaypointMobilityModel does at each leg
+   * \return none
+   */
+  void EnableCourseChanges (void);
+
+private:
+  /**
+   * \brief Notifies the start of a segment and schedules the next one
+   * \param segment the segment starting now
+   * \return none
+   */
+  void StartSegment (const WaypointSegment *segment);
+
+  /**
+   * \brief Schedules StartSegment for a segment
+   * \param segment the segment, or m_end
+   * \return none
+   */
+  void ScheduleSegment (const WaypointSegment *segment);
+
+  /**
+   * \brief Returns the segment covering the current time
+   * \return the segment
+   */
+  const WaypointSegment & Lookup (void) const;
+
+  virtual Vector DoGetPosition (void) const;
+  virtual void DoSetPosition (const Vector &position);
+  virtual Vector DoGetVelocity (void) const;
+
+  Ptr<WaypointTrace> m_trace;
+  const WaypointSegment *m_begin;
+  const WaypointSegment *m_end;
+  // time only moves forward; the last hit is usually still current
+  mutable const WaypointSegment *m_last;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (ReplayMobilityModel);
+
+TypeId
+ReplayMobilityModel::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::ReplayMobilityModel")
+    .SetParent<MobilityModel> ()
+    .AddConstructor<ReplayMobilityModel> ();
+  return tid;
+}
+
+ReplayMobilityModel::ReplayMobilityModel ()
+  : m_begin (NULL),
+    m_end (NULL),
+    m_last (NULL)
+{
+}
+
+void
+ReplayMobilityModel::SetTrace (Ptr<WaypointTrace> trace, uint32_t node)
+{
+  NS_ABORT_MSG_UNLESS (node < trace->GetNNodes (),
+                       "Node " << node << " is not in a trace of " << trace->GetNNodes () << " nodes");
+  m_trace = trace;
+  m_begin = trace->Begin (node);
+  m_end = trace->End (node);
+  NS_ABORT_MSG_UNLESS (m_begin != m_end, "Node " << node << " has no trajectory in the trace");
+  m_last = m_begin;
+}
+
+void
+ReplayMobilityModel::EnableCourseChanges (void)
+{
+  const WaypointSegment *segment = &Lookup ();
+  if (segment->start < Simulator::Now ().GetSeconds ())
+    {
+      segment++;
+    }
+  ScheduleSegment (segment);
+}
+
+void
+ReplayMobilityModel::ScheduleSegment (const WaypointSegment *segment)
+{
+  if (segment != m_end)
+    {
+      Time delay = Seconds (segment->start) - Simulator::Now ();
+      Simulator::Schedule (delay.IsPositive () ? delay : Seconds (0),
+                           &ReplayMobilityModel::StartSegment, this, segment);
+    }
+}
+
+void
+ReplayMobilityModel::StartSegment (const WaypointSegment *segment)
+{
+  m_last = segment;
+  NotifyCourseChange ();
+  ScheduleSegment (segment + 1);
+}
+
+const WaypointSegment &
+ReplayMobilityModel::Lookup (void) const
+{
+  double t = Simulator::Now ().GetSeconds ();
+  const WaypointSegment *next = m_last + 1;
+  if (t >= m_last->start && (next == m_end || t < next->start))
+    {
+      return *m_last;
+    }
+  if (next != m_end && t >= next->start && (next + 1 == m_end || t < (next + 1)->start))
+    {
+      m_last = next;
+      return *m_last;
+    }
+  m_last = std::upper_bound (m_begin, m_end, t, SegmentStartsAfter) - 1;
+  if (m_last < m_begin)
+    {
+      m_last = m_begin;
+    }
+  return *m_last;
+}
+
+Vector
+ReplayMobilityModel::DoGetPosition (void) const
+{
+  const WaypointSegment & s = Lookup ();
+  double dt = std::max (0.0, Simulator::Now ().GetSeconds () - s.start);
+  return Vector (s.x + s.vx * dt, s.y + s.vy * dt, s.z + s.vz * dt);
+}
+
+void
+ReplayMobilityModel::DoSetPosition (const Vector &position)
+{
+  // the trajectory is fixed by the trace
+}
+
+Vector
+ReplayMobilityModel::DoGetVelocity (void) const
+{
+  const WaypointSegment & s = Lookup ();
+  return Vector (s.vx, s.vy, s.vz);
+}
+
+class BatchMobilityModel;
+
+/**
+ * \brief Random waypoint mobility of many nodes, stored as arrays.
+ *
+ * Segment origins, velocities and start times live in contiguous
+ * arrays, one entry per node.  A position is computed for its node
+ * alone until an eighth of the nodes have been asked for at the same
+ * simulation time, as a channel does for the receivers of a frame;
+ * the positions of all nodes are then recomputed in one branch-free
+ * loop, which the compiler vectorizes.  Waypoint arrivals and pause ends are kept in one heap and
+ * handled by a single engine event, instead of one event per node.
+ * BatchMobilityModel is the per-node MobilityModel view.
+ */
+class BatchMobilityEngine : public SimpleRefCount<BatchMobilityEngine>
+{
+public:
+  /**
+   * \brief Constructor
+   * \return none
+   */
+  BatchMobilityEngine ();
+
+  /**
+   * \brief Sets the area the waypoints are drawn from
+   * \param minX lowest x (m)
+   * \param maxX highest x (m)
+   * \param minY lowest y (m)
+   * \param maxY highest y (m)
+   * \return none
+   */
+  void SetBounds (double minX, double maxX, double minY, double maxY);
+
+  /**
+   * \brief Sets the speed and pause distributions
+   * \param speed speed (m/s) of each leg
+   * \param pause pause (s) at each waypoint
+   * \return none
+   */
+  void SetWalk (Ptr<RandomVariableStream> speed, Ptr<RandomVariableStream> pause);
+
+  /**
+   * \brief Assigns the random variable streams
+   * \param stream first stream index
+   * \return the number of streams used
+   */
+  int64_t AssignStreams (int64_t stream);
+
+  /**
+   * \brief Adds a node, paused at the origin until SetPosition
+   * \param model the facade notified of course changes
+   * \return the index of the node
+   */
+  uint32_t Add (BatchMobilityModel *model);
+
+  /**
+   * \brief Detaches the facade of a node
+   * \param index the node index
+   * \return none
+   */
+  void Detach (uint32_t index);
+
+  /**
+   * \brief Returns the current position of a node
+   * \param index the node index
+   * \return the position
+   */
+  Vector GetPosition (uint32_t index);
+
+  /**
+   * \brief Returns the current velocity of a node
+   * \param index the node index
+   * \return the velocity
+   */
+  Vector GetVelocity (uint32_t index);
+
+  /**
+   * \brief Moves a node; it heads for a new waypoint from there
+   * \param index the node index
+   * \param position the position
+   * \return none
+   */
+  void SetPosition (uint32_t index, const Vector & position);
+
+  /**
+   * \brief Returns the number of waypoint arrivals and pause ends
+   * \return the number of course changes
+   */
+  uint64_t GetNCourseChanges () const;
+
+private:
+  /**
+   * \brief Recomputes every position for the current time
+   * \return none
+   */
+  void Update ();
+
+  /**
+   * \brief Starts the next leg or pause of every node whose segment
+   * ended, then waits for the next segment end
+   * \return none
+   */
+  void Advance ();
+
+  /**
+   * \brief Starts the next leg or pause of a node
+   * \param index the node index
+   * \param now the current time (s)
+   * \return none
+   */
+  void NextSegment (uint32_t index, double now);
+
+  /**
+   * \brief Schedules Advance at the earliest segment end
+   * \return none
+   */
+  void Reschedule ();
+
+  typedef std::pair<double, uint32_t> SegmentEnd;
+
+  // segment of each node: position = origin + velocity * (t - start)
+  std::vector<double> m_originX;
+  std::vector<double> m_originY;
+  std::vector<double> m_velocityX;
+  std::vector<double> m_velocityY;
+  std::vector<double> m_start;
+  std::vector<double> m_end;
+  std::vector<double> m_targetX;
+  std::vector<double> m_targetY;
+  // positions at m_updated
+  std::vector<double> m_x;
+  std::vector<double> m_y;
+  std::vector<BatchMobilityModel *> m_models;
+
+  // earliest segment end first; stale entries are skipped
+  std::priority_queue<SegmentEnd, std::vector<SegmentEnd>, std::greater<SegmentEnd> > m_ends;
+  EventId m_event;
+  double m_updated;
+  double m_queried;       // time of the per-node queries counted
+  uint32_t m_nQueries;    // per-node queries at m_queried
+  uint64_t m_nCourseChanges;
+
+  Ptr<UniformRandomVariable> m_x0;
+  Ptr<UniformRandomVariable> m_y0;
+  Ptr<RandomVariableStream> m_speed;
+  Ptr<RandomVariableStream> m_pause;
+};
+
+/**
+ * \brief MobilityModel view of one node of a BatchMobilityEngine
+ */
+class BatchMobilityModel : public MobilityModel
+{
+public:
+  /**
+   * \brief Get class TypeId
+   * \return the TypeId for the class
+   */
+  static TypeId GetTypeId (void);
+
+  /**
+   * \brief Constructor
+   * \return none
+   */
+  BatchMobilityModel ();
+
+  /**
+   * \brief Registers this node with an engine
+   * \param engine the engine
+   * \return none
+   */
+  void SetEngine (Ptr<BatchMobilityEngine> engine);
+
+  /**
+   * \brief Notifies the CourseChange listeners; called by the engine
+   * \return none
+   */
+  void CourseChanged (void);
+
+private:
+  virtual void DoDispose (void);
+  virtual Vector DoGetPosition (void) const;
+  virtual void DoSetPosition (const Vector &position);
+  virtual Vector DoGetVelocity (void) const;
+
+  Ptr<BatchMobilityEngine> m_engine;
+  uint32_t m_index;
+};
+
+BatchMobilityEngine::BatchMobilityEngine ()
+  : m_updated (-1),
+    m_queried (-1),
+    m_nQueries (0),
+    m_nCourseChanges (0)
+{
+  m_x0 = CreateObject<UniformRandomVariable> ();
+  m_y0 = CreateObject<UniformRandomVariable> ();
+  SetBounds (0, 100, 0, 100);
+  Ptr<UniformRandomVariable> speed = CreateObject<UniformRandomVariable> ();
+  speed->SetAttribute ("Min", DoubleValue (0.3));
+  speed->SetAttribute ("Max", DoubleValue (0.7));
+  SetWalk (speed, CreateObject<ConstantRandomVariable> ());
+}
+
+void
+BatchMobilityEngine::SetBounds (double minX, double maxX, double minY, double maxY)
+{
+  m_x0->SetAttribute ("Min", DoubleValue (minX));
+  m_x0->SetAttribute ("Max", DoubleValue (maxX));
+  m_y0->SetAttribute ("Min", DoubleValue (minY));
+  m_y0->SetAttribute ("Max", DoubleValue (maxY));
+}
+
+void
+BatchMobilityEngine::SetWalk (Ptr<RandomVariableStream> speed, Ptr<RandomVariableStream> pause)
+{
+  m_speed = speed;
+  m_pause = pause;
+}
+
+int64_t
+BatchMobilityEngine::AssignStreams (int64_t stream)
+{
+  m_x0->SetStream (stream);
+  m_y0->SetStream (stream + 1);
+  m_speed->SetStream (stream + 2);
+  m_pause->SetStream (stream + 3);
+  return 4;
+}
+
+uint32_t
+BatchMobilityEngine::Add (BatchMobilityModel *model)
+{
+  double now = Simulator::Now ().GetSeconds ();
+  m_originX.push_back (0);
+  m_originY.push_back (0);
+  m_velocityX.push_back (0);
+  m_velocityY.push_back (0);
+  m_start.push_back (now);
+  m_end.push_back (std::numeric_limits<double>::infinity ());
+  m_targetX.push_back (0);
+  m_targetY.push_back (0);
+  m_x.push_back (0);
+  m_y.push_back (0);
+  m_models.push_back (model);
+  m_updated = -1;
+  return m_models.size () - 1;
+}
+
+void
+BatchMobilityEngine::Detach (uint32_t index)
+{
+  m_models[index] = NULL;
+}
+
+void
+BatchMobilityEngine::Update ()
+{
+  double now = Simulator::Now ().GetSeconds ();
+  if (now == m_updated)
+    {
+      return;
+    }
+  m_updated = now;
+
+  uint32_t n = m_x.size ();
+  if (n == 0)
+    {
+      return;
+    }
+  const double *originX = &m_originX[0];
+  const double *originY = &m_originY[0];
+  const double *velocityX = &m_velocityX[0];
+  const double *velocityY = &m_velocityY[0];
+  const double *start = &m_start[0];
+  double *x = &m_x[0];
+  double *y = &m_y[0];
+  for (uint32_t i = 0; i < n; i++)
+    {
+      double dt = now - start[i];
+      x[i] = originX[i] + velocityX[i] * dt;
+      y[i] = originY[i] + velocityY[i] * dt;
+    }
+}
+
+Vector
+BatchMobilityEngine::GetPosition (uint32_t index)
+{
+  double now = Simulator::Now ().GetSeconds ();
+  if (now != m_updated)
+    {
+      if (now != m_queried)
+        {
+          m_queried = now;
+          m_nQueries = 0;
+        }
+      // a lone query costs one node; a sweep over the nodes switches
+      // to the batched update
+      if (++m_nQueries <= std::max<uint32_t> (8, m_x.size () / 8))
+        {
+          double dt = now - m_start[index];
+          return Vector (m_originX[index] + m_velocityX[index] * dt,
+                         m_originY[index] + m_velocityY[index] * dt, 0);
+        }
+      Update ();
+    }
+  return Vector (m_x[index], m_y[index], 0);
+}
+
+Vector
+BatchMobilityEngine::GetVelocity (uint32_t index)
+{
+  return Vector (m_velocityX[index], m_velocityY[index], 0);
+}
+
+void
+BatchMobilityEngine::SetPosition (uint32_t index, const Vector & position)
+{
+  double now = Simulator::Now ().GetSeconds ();
+  m_originX[index] = m_targetX[index] = position.x;
+  m_originY[index] = m_targetY[index] = position.y;
+  m_velocityX[index] = 0;
+  m_velocityY[index] = 0;
+  m_start[index] = now;
+  // a zero pause: the next leg starts now
+  m_end[index] = now;
+  m_ends.push (SegmentEnd (now, index));
+  m_updated = -1;
+  Reschedule ();
+}
+
+void
+BatchMobilityEngine::NextSegment (uint32_t index, double now)
+{
+  double x = m_targetX[index];
+  double y = m_targetY[index];
+  m_originX[index] = x;
+  m_originY[index] = y;
+  m_start[index] = now;
+  if (m_velocityX[index] != 0 || m_velocityY[index] != 0)
+    {
+      // arrived: pause at the waypoint
+      m_velocityX[index] = 0;
+      m_velocityY[index] = 0;
+      m_end[index] = now + m_pause->GetValue ();
+    }
+  else
+    {
+      // paused: walk to a new waypoint
+      double tx = m_x0->GetValue ();
+      double ty = m_y0->GetValue ();
+      double speed = m_speed->GetValue ();
+      double distance = std::sqrt ((tx - x) * (tx - x) + (ty - y) * (ty - y));
+      m_targetX[index] = tx;
+      m_targetY[index] = ty;
+      if (speed > 0 && distance > 0)
+        {
+          m_velocityX[index] = speed * (tx - x) / distance;
+          m_velocityY[index] = speed * (ty - y) / distance;
+          m_end[index] = now + distance / speed;
+        }
+      else
+        {
+          m_targetX[index] = x;
+          m_targetY[index] = y;
+          m_end[index] = speed > 0 ? now : std::numeric_limits<double>::infinity ();
+        }
+    }
+  if (m_end[index] != std::numeric_limits<double>::infinity ())
+    {
+      m_ends.push (SegmentEnd (m_end[index], index));
+    }
+  m_nCourseChanges++;
+}
+
+void
+BatchMobilityEngine::Advance ()
+{
+  double now = Simulator::Now ().GetSeconds ();
+  std::vector<uint32_t> changed;
+  // compared as Time, as they were scheduled, so rounding cannot stall
+  while (!m_ends.empty () && Seconds (m_ends.top ().first) <= Simulator::Now ())
+    {
+      SegmentEnd end = m_ends.top ();
+      m_ends.pop ();
+      if (end.first != m_end[end.second])
+        {
+          // superseded by SetPosition
+          continue;
+        }
+      NextSegment (end.second, now);
+      changed.push_back (end.second);
+    }
+  m_updated = -1;
+  for (uint32_t i = 0; i < changed.size (); i++)
+    {
+      if (m_models[changed[i]] != NULL)
+        {
+          m_models[changed[i]]->CourseChanged ();
+        }
+    }
+  Reschedule ();
+}
+
+void
+BatchMobilityEngine::Reschedule ()
+{
+  while (!m_ends.empty () && m_ends.top ().first != m_end[m_ends.top ().second])
+    {
+      m_ends.pop ();
+    }
+  if (m_ends.empty ())
+    {
+      return;
+    }
+  Time next = Seconds (m_ends.top ().first);
+  if (m_event.IsRunning () && TimeStep (m_event.GetTs ()) <= next)
+    {
+      return;
+    }
+  m_event.Cancel ();
+  m_event = Simulator::Schedule (std::max (next - Simulator::Now (), Time (0)),
+                                 &BatchMobilityEngine::Advance, this);
+}
+
+uint64_t
+BatchMobilityEngine::GetNCourseChanges () const
+{
+  return m_nCourseChanges;
+}
+
+NS_OBJECT_ENSURE_REGISTERED (BatchMobilityModel);
+
+TypeId
+BatchMobilityModel::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::BatchMobilityModel")
+    .SetParent<MobilityModel> ()
+    .AddConstructor<BatchMobilityModel> ();
+  return tid;
+}
+
+BatchMobilityModel::BatchMobilityModel ()
+  : m_index (0)
+{
+}
+
+void
+BatchMobilityModel::SetEngine (Ptr<BatchMobilityEngine> engine)
+{
+  m_engine = engine;
+  m_index = engine->Add (this);
+}
+
+void
+BatchMobilityModel::CourseChanged (void)
+{
+  NotifyCourseChange ();
+}
+
+void
+BatchMobilityModel::DoDispose (void)
+{
+  if (m_engine != 0)
+    {
+      m_engine->Detach (m_index);
+      m_engine = 0;
+    }
+  MobilityModel::DoDispose ();
+}
+
+Vector
+BatchMobilityModel::DoGetPosition (void) const
+{
+  return m_engine->GetPosition (m_index);
+}
+
+void
+BatchMobilityModel::DoSetPosition (const Vector &position)
+{
+  m_engine->SetPosition (m_index, position);
+}
+
+Vector
+BatchMobilityModel::DoGetVelocity (void) const
+{
+  return m_engine->GetVelocity (m_index);
+}
+
+/**
+ * \brief Compresses NetAnim trace chunks in a background thread.
+ *
+ * AnimationInterface rolls over to "<file>-0", "<file>-1", ... once
+ * SetMaxPktsPerTraceFile packets are written.  A chunk is complete as
+ * soon as its successor exists; complete chunks are gzipped by a
+ * worker thread so disk usage stays bounded during the run.
+ */
+class AnimationChunkCompressor
+{
+public:
+  /**
+   * \brief Constructor
+   * \return none
+   */
+  AnimationChunkCompressor ();
+
+  /**
+   * \brief Destructor; waits for pending compressions
+   * \return none
+   */
+  ~AnimationChunkCompressor ();
+
+  /**
+   * \brief Starts watching the chunks of a trace file
+   * \param fileName the file name given to AnimationInterface
+   * \param pollInterval simulation time between checks for new chunks
+   * \return none
+   */
+  void Start (std::string fileName, Time pollInterval);
+
+  /**
+   * \brief Compresses the remaining chunks and stops the worker.  Must
+   * be called after the AnimationInterface has been destroyed.
+   * \return none
+   */
+  void Finish ();
+
+  /**
+   * \brief Returns the number of chunks handed to the compressor
+   * \return the number of chunks
+   */
+  uint32_t GetNChunks () const;
+
+private:
+  /**
+   * \brief Checks for chunks completed since the last poll
+   * \return none
+   */
+  void Poll ();
+
+  /**
+   * \brief Worker thread body
+   * \return none
+   */
+  void Compress ();
+
+  /**
+   * \brief Runs gzip on a file without going through a shell
+   * \param fileName the file to compress
+   * \return true if gzip succeeded
+   */
+  static bool Gzip (std::string fileName);
+
+  /**
+   * \brief Returns the name of a rolled over chunk
+   * \param index the chunk index
+   * \return the chunk file name
+   */
+  std::string ChunkName (uint32_t index) const;
+
+  std::string m_fileName;
+  std::string m_current;             // chunk AnimationInterface writes to
+  uint32_t m_nextChunk;
+  uint32_t m_nChunks;
+  Time m_pollInterval;
+  std::deque<std::string> m_queue;   // guarded by m_mutex
+  bool m_done;                       // guarded by m_mutex
+  SystemMutex m_mutex;
+  SystemCondition m_queued;
+  Ptr<SystemThread> m_worker;
+};
+
+AnimationChunkCompressor::AnimationChunkCompressor ()
+  : m_nextChunk (0),
+    m_nChunks (0),
+    m_done (false)
+{
+}
+
+AnimationChunkCompressor::~AnimationChunkCompressor ()
+{
+  if (m_worker != 0)
+    {
+      Finish ();
+    }
+}
+
+void
+AnimationChunkCompressor::Start (std::string fileName, Time pollInterval)
+{
+  m_fileName = fileName;
+  m_current = fileName;
+  m_pollInterval = pollInterval;
+  m_done = false;
+  m_worker = Create<SystemThread> (MakeCallback (&AnimationChunkCompressor::Compress, this));
+  m_worker->Start ();
+  Simulator::Schedule (m_pollInterval, &AnimationChunkCompressor::Poll, this);
+}
+
+std::string
+AnimationChunkCompressor::ChunkName (uint32_t index) const
+{
+  std::ostringstream oss;
+  oss << m_fileName << "-" << index;
+  return oss.str ();
+}
+
+void
+AnimationChunkCompressor::Poll ()
+{
+  while (access (ChunkName (m_nextChunk).c_str (), F_OK) == 0)
+    {
+      m_mutex.Lock ();
+      m_queue.push_back (m_current);
+      m_mutex.Unlock ();
+      m_queued.SetCondition (true);
+      m_queued.Signal ();
+      m_nChunks++;
+      m_current = ChunkName (m_nextChunk++);
+    }
+  if (m_worker != 0)
+    {
+      Simulator::Schedule (m_pollInterval, &AnimationChunkCompressor::Poll, this);
+    }
+}
+
+void
+AnimationChunkCompressor::Finish ()
+{
+  if (m_worker == 0)
+    {
+      return;
+    }
+  Ptr<SystemThread> worker = m_worker;
+  m_worker = 0;
+  Poll ();
+  m_mutex.Lock ();
+  m_queue.push_back (m_current);
+  m_done = true;
+  m_mutex.Unlock ();
+  m_nChunks++;
+  m_queued.SetCondition (true);
+  m_queued.Signal ();
+  worker->Join ();
+}
+
+uint32_t
+AnimationChunkCompressor::GetNChunks () const
+{
+  return m_nChunks;
+}
+
+void
+AnimationChunkCompressor::Compress ()
+{
+  for (;;)
+    {
+      m_mutex.Lock ();
+      // cleared before the queue is read, so a Poll after the read
+      // sets it again and TimedWait returns at once
+      m_queued.SetCondition (false);
+      bool done = m_done;
+      std::string next;
+      if (!m_queue.empty ())
+        {
+          next = m_queue.front ();
+          m_queue.pop_front ();
+        }
+      m_mutex.Unlock ();
+
+      if (next.empty ())
+        {
+          if (done)
+            {
+              break;
+            }
+          m_queued.TimedWait (1000000000);
+          continue;
+        }
+      if (!Gzip (next))
+        {
+          NS_LOG_ERROR ("Unable to compress " << next);
+        }
+    }
+}
+
+bool
+AnimationChunkCompressor::Gzip (std::string fileName)
+{
+  // no shell: the name is passed as one argument, after "--"
+  const char *argv[] = { "gzip", "-f", "--", fileName.c_str (), NULL };
+  pid_t pid = fork ();
+  if (pid == 0)
+    {
+      execvp (argv[0], const_cast<char * const *> (argv));
+      _exit (127);
+    }
+  if (pid < 0)
+    {
+      return false;
+    }
+  int status;
+  while (waitpid (pid, &status, 0) < 0)
+    {
+      if (errno != EINTR)
+        {
+          return false;
+        }
+    }
+  return WIFEXITED (status) && WEXITSTATUS (status) == 0;
+}
+
+/**
+ * \brief Returns a monotonic wall clock reading
+ * \return milliseconds since an arbitrary origin
+ */
+static double
+WallClockMs ()
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+/**
+ * \brief Returns the peak resident set size of the process
+ * \return the peak RSS in KiB
+ */
+static long
+PeakRssKb ()
+{
+  struct rusage usage;
+  getrusage (RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+/**
+ * \brief Ladder queue scheduler (Tang, Goh and Thng, 2005).
+ *
+ * Far future events are appended unsorted to the top; when the near
+ * events run out, the top is spread over a rung of buckets, crowded
+ * buckets are split into finer rungs and only a small bucket at a time
+ * is sorted into the bottom list the events are taken from.  Insert
+ * and RemoveNext are amortized O(1) for the event sets of large
+ * scenarios.
+ */
+class LadderScheduler : public Scheduler
+{
+public:
+  /**
+   * \brief Get class TypeId
+   * \return the TypeId for the class
+   */
+  static TypeId GetTypeId (void);
+
+  /**
+   * \brief Constructor
+   * \return none
+   */
+  LadderScheduler ();
+
+  /**
+   * \brief Destructor
+   * \return none
+   */
+  virtual ~LadderScheduler ();
+
+  virtual void Insert (const Event &ev);
+  virtual bool IsEmpty (void) const;
+  virtual Event PeekNext (void) const;
+  virtual Event RemoveNext (void);
+  virtual void Remove (const Event &ev);
+
+private:
+  typedef std::vector<Event> Bucket;
+
+  /**
+   * \brief A level of buckets covering [start, start + width * buckets.size ())
+   */
+  struct Rung
+  {
+    uint64_t start;
+    uint64_t width;
+    uint32_t current;        // buckets before this one are consumed
+    std::vector<Bucket> buckets;
+  };
+
+  /**
+   * \brief Orders events by their key, latest first
+   */
+  struct Later
+  {
+    bool operator() (const Event & a, const Event & b) const;
+  };
+
+  /**
+   * \brief Makes sure the bottom holds the next events, if any
+   * \return none
+   */
+  void Refill (void) const;
+
+  /**
+   * \brief Spreads events over a new, finer rung
+   * \param events the events, all within [start, end]
+   * \param start the lowest timestamp
+   * \param end the highest timestamp
+   * \return none
+   */
+  void SpawnRung (Bucket & events, uint64_t start, uint64_t end) const;
+
+  /**
+   * \brief Inserts into the sorted bottom
+   * \param ev the event
+   * \return none
+   */
+  void InsertBottom (const Event & ev) const;
+
+  /**
+   * \brief Removes an event from a bucket, if present
+   * \param bucket the bucket
+   * \param ev the event
+   * \return true if it was found
+   */
+  static bool RemoveFrom (Bucket & bucket, const Event & ev);
+
+  static const uint32_t BOTTOM_THRESHOLD = 50;
+  static const uint32_t MAX_RUNGS = 8;
+
+  // Refill, run from the const PeekNext, moves events between levels
+  mutable Bucket m_top;              // unsorted, all at or after m_topStart
+  mutable uint64_t m_topStart;
+  mutable uint64_t m_topMin;
+  mutable uint64_t m_topMax;
+  mutable std::vector<Rung> m_rungs; // coarsest first
+  mutable Bucket m_bottom;           // sorted, next event last
+  uint32_t m_size;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (LadderScheduler);
+
+TypeId
+LadderScheduler::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::LadderScheduler")
+    .SetParent<Scheduler> ()
+    .AddConstructor<LadderScheduler> ();
+  return tid;
+}
+
+LadderScheduler::LadderScheduler ()
+  : m_topStart (0),
+    m_topMin (0),
+    m_topMax (0),
+    m_size (0)
+{
+}
+
+LadderScheduler::~LadderScheduler ()
+{
+}
+
+bool
+LadderScheduler::Later::operator() (const Event & a, const Event & b) const
+{
+  return b.key < a.key;
+}
+
+void
+LadderScheduler::InsertBottom (const Event & ev) const
+{
+  m_bottom.insert (std::upper_bound (m_bottom.begin (), m_bottom.end (), ev, Later ()), ev);
+}
+
+void
+LadderScheduler::Insert (const Event &ev)
+{
+  m_size++;
+  uint64_t ts = ev.key.m_ts;
+  if (ts >= m_topStart)
+    {
+      if (m_top.empty ())
+        {
+          m_topMin = m_topMax = ts;
+        }
+      m_topMin = std::min (m_topMin, ts);
+      m_topMax = std::max (m_topMax, ts);
+      m_top.push_back (ev);
+      return;
+    }
+  for (uint32_t r = 0; r < m_rungs.size (); r++)
+    {
+      Rung & rung = m_rungs[r];
+      if (ts >= rung.start + rung.width * rung.current)
+        {
+          rung.buckets[(ts - rung.start) / rung.width].push_back (ev);
+          return;
+        }
+    }
+  InsertBottom (ev);
+}
+
+bool
+LadderScheduler::IsEmpty (void) const
+{
+  return m_size == 0;
+}
+
+void
+LadderScheduler::SpawnRung (Bucket & events, uint64_t start, uint64_t end) const
+{
+  Rung rung;
+  uint32_t n = events.size ();
+  rung.start = start;
+  rung.width = (end - start) / n + 1;
+  rung.current = 0;
+  rung.buckets.resize ((end - start) / rung.width + 1);
+  for (uint32_t i = 0; i < n; i++)
+    {
+      rung.buckets[(events[i].key.m_ts - start) / rung.width].push_back (events[i]);
+    }
+  events.clear ();
+  m_rungs.push_back (rung);
+}
+
+void
+LadderScheduler::Refill (void) const
+{
+  while (m_bottom.empty ())
+    {
+      if (m_rungs.empty ())
+        {
+          if (m_top.empty ())
+            {
+              return;
+            }
+          // later inserts go to the top again once past this rung
+          uint64_t start = m_topMin;
+          uint64_t end = m_topMax;
+          SpawnRung (m_top, start, end);
+          m_topStart = start + m_rungs.back ().width * m_rungs.back ().buckets.size ();
+          continue;
+        }
+
+      Rung & rung = m_rungs.back ();
+      while (rung.current < rung.buckets.size () && rung.buckets[rung.current].empty ())
+        {
+          rung.current++;
+        }
+      if (rung.current == rung.buckets.size ())
+        {
+          m_rungs.pop_back ();
+          continue;
+        }
+
+      Bucket & bucket = rung.buckets[rung.current];
+      uint64_t bucketStart = rung.start + rung.width * rung.current;
+      rung.current++;
+      uint64_t minTs = bucket[0].key.m_ts;
+      uint64_t maxTs = minTs;
+      for (uint32_t i = 1; i < bucket.size (); i++)
+        {
+          minTs = std::min (minTs, bucket[i].key.m_ts);
+          maxTs = std::max (maxTs, bucket[i].key.m_ts);
+        }
+      if (bucket.size () > BOTTOM_THRESHOLD && m_rungs.size () < MAX_RUNGS && minTs != maxTs)
+        {
+          // the child covers exactly the consumed bucket
+          Bucket events;
+          events.swap (bucket);
+          SpawnRung (events, bucketStart, std::max (maxTs, bucketStart + rung.width - 1));
+          continue;
+        }
+      m_bottom.swap (bucket);
+      std::sort (m_bottom.begin (), m_bottom.end (), Later ());
+    }
+}
+
+Scheduler::Event
+LadderScheduler::PeekNext (void) const
+{
+  NS_ASSERT (m_size > 0);
+  Refill ();
+  return m_bottom.back ();
+}
+
+Scheduler::Event
+LadderScheduler::RemoveNext (void)
+{
+  NS_ASSERT (m_size > 0);
+  Refill ();
+  Event ev = m_bottom.back ();
+  m_bottom.pop_back ();
+  m_size--;
+  return ev;
+}
+
+bool
+LadderScheduler::RemoveFrom (Bucket & bucket, const Event & ev)
+{
+  for (Bucket::iterator i = bucket.begin (); i != bucket.end (); ++i)
+    {
+      if (i->key.m_uid == ev.key.m_uid)
+        {
+          bucket.erase (i);
+          return true;
+        }
+    }
+  return false;
+}
+
+void
+LadderScheduler::Remove (const Event &ev)
+{
+  uint64_t ts = ev.key.m_ts;
+  bool found = RemoveFrom (m_bottom, ev);
+  for (uint32_t r = 0; !found && r < m_rungs.size (); r++)
+    {
+      Rung & rung = m_rungs[r];
+      uint64_t index = (ts - rung.start) / rung.width;
+      if (ts >= rung.start && index < rung.buckets.size ())
+        {
+          found = RemoveFrom (rung.buckets[index], ev);
+        }
+    }
+  if (!found)
+    {
+      found = RemoveFrom (m_top, ev);
+    }
+  NS_ASSERT (found);
+  m_size--;
+}
+
+/**
+ * \brief Scheduler wrapper recording the operations of a run, so the
+ * event stream can be replayed against other schedulers.
+ *
+ * Every Insert, RemoveNext and Remove is appended to the trace file as
+ * a fixed-size SchedulerTraceRecord.
+ */
+class RecordingScheduler : public Scheduler
+{
+public:
+  /**
+   * \brief Operation kinds of a SchedulerTraceRecord
+   */
+  enum Operation
+  {
+    INSERT = 0,
+    REMOVE_NEXT,
+    REMOVE
+  };
+
+  /**
+   * \brief One recorded operation
+   */
+  struct SchedulerTraceRecord
+  {
+    uint64_t ts;
+    uint32_t uid;
+    uint32_t operation;
+  };
+
+  /**
+   * \brief Get class TypeId
+   * \return the TypeId for the class
+   */
+  static TypeId GetTypeId (void);
+
+  /**
+   * \brief Constructor
+   * \return none
+   */
+  RecordingScheduler ();
+
+  /**
+   * \brief Destructor; closes the trace
+   * \return none
+   */
+  virtual ~RecordingScheduler ();
+
+  virtual void Insert (const Event &ev);
+  virtual bool IsEmpty (void) const;
+  virtual Event PeekNext (void) const;
+  virtual Event RemoveNext (void);
+  virtual void Remove (const Event &ev);
+
+  /**
+   * \brief Replays a recorded trace against a scheduler
+   * \param records the recorded operations
+   * \param tid the TypeId name of the scheduler
+   * \return the wall time of the replay in milliseconds
+   */
+  static double Replay (const std::vector<SchedulerTraceRecord> & records, std::string tid);
+
+  /**
+   * \brief Reads a recorded trace
+   * \param fileName the trace file
+   * \param records receives the operations
+   * \return true on success
+   */
+  static bool Load (std::string fileName, std::vector<SchedulerTraceRecord> & records);
+
+private:
+  /**
+   * \brief Appends an operation to the trace
+   * \param ev the event
+   * \param operation the operation
+   * \return none
+   */
+  void Record (const Event & ev, Operation operation);
+
+  /**
+   * \brief Opens the trace file
+   * \param fileName the trace file
+   * \return none
+   */
+  void SetTraceFile (std::string fileName);
+
+  /**
+   * \brief Returns the trace file
+   * \return the trace file name
+   */
+  std::string GetTraceFile (void) const;
+
+  /**
+   * \brief Replaces the wrapped scheduler
+   * \param tid the TypeId name of the scheduler
+   * \return none
+   */
+  void SetInner (std::string tid);
+
+  /**
+   * \brief Returns the wrapped scheduler
+   * \return the TypeId name of the scheduler
+   */
+  std::string GetInner (void) const;
+
+  Ptr<Scheduler> m_inner;
+  std::string m_traceFile;
+  FILE *m_file;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (RecordingScheduler);
+
+TypeId
+RecordingScheduler::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::RecordingScheduler")
+    .SetParent<Scheduler> ()
+    .AddConstructor<RecordingScheduler> ()
+    .AddAttribute ("Inner",
+                   "The TypeId of the scheduler keeping the events",
+                   StringValue ("ns3::MapScheduler"),
+                   MakeStringAccessor (&RecordingScheduler::SetInner,
+                                       &RecordingScheduler::GetInner),
+                   MakeStringChecker ())
+    .AddAttribute ("TraceFile",
+                   "The file the scheduler operations are written to",
+                   StringValue ("scheduler.trace"),
+                   MakeStringAccessor (&RecordingScheduler::SetTraceFile,
+                                       &RecordingScheduler::GetTraceFile),
+                   MakeStringChecker ());
+  return tid;
+}
+
+RecordingScheduler::RecordingScheduler ()
+  : m_file (NULL)
+{
+}
+
+RecordingScheduler::~RecordingScheduler ()
+{
+  if (m_file != NULL)
+    {
+      std::fclose (m_file);
+    }
+}
+
+void
+RecordingScheduler::SetTraceFile (std::string fileName)
+{
+  if (m_file != NULL)
+    {
+      std::fclose (m_file);
+    }
+  m_traceFile = fileName;
+  m_file = std::fopen (fileName.c_str (), "wb");
+  if (m_file == NULL)
+    {
+      NS_LOG_ERROR ("Unable to open scheduler trace " << fileName);
+    }
+}
+
+std::string
+RecordingScheduler::GetTraceFile (void) const
+{
+  return m_traceFile;
+}
+
+void
+RecordingScheduler::SetInner (std::string tid)
+{
+  NS_ASSERT_MSG (m_inner == 0 || m_inner->IsEmpty (), "Cannot replace a non-empty scheduler");
+  ObjectFactory factory;
+  factory.SetTypeId (tid);
+  m_inner = factory.Create<Scheduler> ();
+}
+
+std::string
+RecordingScheduler::GetInner (void) const
+{
+  return m_inner == 0 ? "" : m_inner->GetInstanceTypeId ().GetName ();
+}
+
+void
+RecordingScheduler::Record (const Event & ev, Operation operation)
+{
+  if (m_file != NULL)
+    {
+      SchedulerTraceRecord r;
+      r.ts = ev.key.m_ts;
+      r.uid = ev.key.m_uid;
+      r.operation = operation;
+      std::fwrite (&r, sizeof (r), 1, m_file);
+    }
+}
+
+void
+RecordingScheduler::Insert (const Event &ev)
+{
+  Record (ev, INSERT);
+  m_inner->Insert (ev);
+}
+
+bool
+RecordingScheduler::IsEmpty (void) const
+{
+  return m_inner->IsEmpty ();
+}
+
+Scheduler::Event
+RecordingScheduler::PeekNext (void) const
+{
+  return m_inner->PeekNext ();
+}
+
+Scheduler::Event
+RecordingScheduler::RemoveNext (void)
+{
+  Event ev = m_inner->RemoveNext ();
+  Record (ev, REMOVE_NEXT);
+  return ev;
+}
+
+void
+RecordingScheduler::Remove (const Event &ev)
+{
+  Record (ev, REMOVE);
+  m_inner->Remove (ev);
+}
+
+bool
+RecordingScheduler::Load (std::string fileName, std::vector<SchedulerTraceRecord> & records)
+{
+  FILE *in = std::fopen (fileName.c_str (), "rb");
+  if (in == NULL)
+    {
+      return false;
+    }
+  SchedulerTraceRecord r;
+  while (std::fread (&r, sizeof (r), 1, in) == 1)
+    {
+      records.push_back (r);
+    }
+  std::fclose (in);
+  return true;
+}
+
+double
+RecordingScheduler::Replay (const std::vector<SchedulerTraceRecord> & records, std::string tid)
+{
+  ObjectFactory factory;
+  factory.SetTypeId (tid);
+  Ptr<Scheduler> scheduler = factory.Create<Scheduler> ();
+
+  double start = WallClockMs ();
+  for (std::vector<SchedulerTraceRecord>::const_iterator i = records.begin (); i != records.end (); ++i)
+    {
+      Event ev;
+      ev.impl = NULL;
+      ev.key.m_ts = i->ts;
+      ev.key.m_uid = i->uid;
+      ev.key.m_context = 0;
+      switch (i->operation)
+        {
+        case INSERT:
+          scheduler->Insert (ev);
+          break;
+        case REMOVE_NEXT:
+          scheduler->RemoveNext ();
+          break;
+        case REMOVE:
+          scheduler->Remove (ev);
+          break;
+        }
+    }
+  return WallClockMs () - start;
+}
+
+/**
+ * \brief Maps a short scheduler name to its TypeId name
+ * \param name map, list, heap, calendar, ladder, or a TypeId name
+ * \return the TypeId name
+ */
+static std::string
+SchedulerTypeId (std::string name)
+{
+  if (name == "map" || name == "list" || name == "heap" || name == "calendar" || name == "ladder")
+    {
+      name[0] = std::toupper (name[0]);
+      return "ns3::" + name + "Scheduler";
+    }
+  return name;
+}
+
+/**
+ * \brief Scheduler wrapper profiling the events run by Simulator::Run.
+ *
+ * DefaultSimulatorImpl takes every event out with RemoveNext, invokes
+ * it and then asks IsEmpty before the next one, so the time between
+ * these two calls is the cost of the event.  Events are grouped by the
+ * function they call: the EventImpl classes of MakeEvent keep the
+ * function or member function pointer right after the EventImpl base
+ * (and, for members, after the object), which is read with the
+ * Itanium C++ ABI layout and named with dladdr.  Other EventImpl types,
+ * and targets without a dynamic symbol (link the program with
+ * -rdynamic to name its own functions), are reported by the EventImpl
+ * type and target address.  The actual queue is kept by the wrapped
+ * scheduler.
+ */
+class ProfilingScheduler : public Scheduler
+{
+public:
+  /**
+   * \brief Get class TypeId
+   * \return the TypeId for the class
+   */
+  static TypeId GetTypeId (void);
+
+  /**
+   * \brief Constructor
+   * \return none
+   */
+  ProfilingScheduler ();
+
+  /**
+   * \brief Destructor
+   * \return none
+   */
+  virtual ~ProfilingScheduler ();
+
+  virtual void Insert (const Event &ev);
+  virtual bool IsEmpty (void) const;
+  virtual Event PeekNext (void) const;
+  virtual Event RemoveNext (void);
+  virtual void Remove (const Event &ev);
+
+  /**
+   * \brief Stops profiling of the active scheduler and writes its
+   * report, sorted by cumulative cost.  Call after Simulator::Run,
+   * before Simulator::Destroy drains the remaining events.
+   * \param fileName the report file
+   * \return true if a profiling scheduler was active
+   */
+  static bool WriteReport (std::string fileName);
+
+private:
+  /**
+   * \brief Cost of one event target
+   */
+  struct EventStats
+  {
+    uint64_t count;
+    double totalNs;
+    uint64_t histogram[32];  // bucket i: [2^i, 2^(i+1)) ns
+  };
+
+  /**
+   * \brief EventImpl type and the function it calls, 0 if unknown
+   */
+  typedef std::pair<const char *, const void *> EventTarget;
+
+  /**
+   * \brief Returns the function an event calls
+   * \param impl the event
+   * \param type the mangled name of the dynamic type of impl
+   * \return the function address, or 0 for other EventImpl types
+   */
+  const void * GetTarget (const EventImpl *impl, const char *type) const;
+
+  /**
+   * \brief Names an event target for the report
+   * \param target the target
+   * \return the demangled function name, else the EventImpl type and
+   * target address
+   */
+  static std::string GetTargetName (const EventTarget & target);
+
+  /**
+   * \brief Accounts the event removed last, if any
+   * \return none
+   */
+  void Close (void) const;
+
+  /**
+   * \brief Sets the type of the wrapped scheduler
+   * \param tid the TypeId name of the wrapped scheduler
+   * \return none
+   */
+  void SetInner (std::string tid);
+
+  /**
+   * \brief Returns the type of the wrapped scheduler
+   * \return the TypeId name
+   */
+  std::string GetInner (void) const;
+
+  Ptr<Scheduler> m_inner;
+  mutable bool m_pending;
+  mutable EventTarget m_pendingTarget;
+  mutable struct timespec m_pendingStart;
+  mutable std::map<EventTarget, EventStats> m_stats;
+  mutable std::map<const char *, int> m_kinds; // 0=other, 1=function, 2=member
+  bool m_enabled;
+
+  static ProfilingScheduler *g_active;
+};
+
+ProfilingScheduler *ProfilingScheduler::g_active = NULL;
+
+NS_OBJECT_ENSURE_REGISTERED (ProfilingScheduler);
+
+TypeId
+ProfilingScheduler::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::ProfilingScheduler")
+    .SetParent<Scheduler> ()
+    .AddConstructor<ProfilingScheduler> ()
+    .AddAttribute ("Inner",
+                   "The TypeId of the scheduler keeping the events",
+                   StringValue ("ns3::MapScheduler"),
+                   MakeStringAccessor (&ProfilingScheduler::SetInner,
+                                       &ProfilingScheduler::GetInner),
+                   MakeStringChecker ());
+  return tid;
+}
+
+ProfilingScheduler::ProfilingScheduler ()
+  : m_pending (false),
+    m_pendingTarget (),
+    m_enabled (true)
+{
+  g_active = this;
+}
+
+ProfilingScheduler::~ProfilingScheduler ()
+{
+  if (g_active == this)
+    {
+      g_active = NULL;
+    }
+}
+
+void
+ProfilingScheduler::SetInner (std::string tid)
+{
+  NS_ASSERT_MSG (m_inner == 0 || m_inner->IsEmpty (), "Cannot replace a non-empty scheduler");
+  ObjectFactory factory;
+  factory.SetTypeId (tid);
+  m_inner = factory.Create<Scheduler> ();
+}
+
+std::string
+ProfilingScheduler::GetInner (void) const
+{
+  return m_inner == 0 ? "" : m_inner->GetInstanceTypeId ().GetName ();
+}
+
+void
+ProfilingScheduler::Close (void) const
+{
+  if (!m_pending)
+    {
+      return;
+    }
+  m_pending = false;
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  double ns = (now.tv_sec - m_pendingStart.tv_sec) * 1e9 + (now.tv_nsec - m_pendingStart.tv_nsec);
+  EventStats & stats = m_stats[m_pendingTarget];
+  stats.count++;
+  stats.totalNs += ns;
+  uint32_t bucket = 0;
+  for (uint64_t v = static_cast<uint64_t> (ns); v > 1 && bucket < 31; v >>= 1)
+    {
+      bucket++;
+    }
+  stats.histogram[bucket]++;
+}
+
+const void *
+ProfilingScheduler::GetTarget (const EventImpl *impl, const char *type) const
+{
+  std::map<const char *, int>::iterator kind = m_kinds.find (type);
+  if (kind == m_kinds.end ())
+    {
+      int k = 0;
+      if (std::strstr (type, "EventFunctionImpl") != NULL)
+        {
+          k = 1;
+        }
+      else if (std::strstr (type, "EventMemberImpl") != NULL)
+        {
+          k = 2;
+        }
+      kind = m_kinds.insert (std::make_pair (type, k)).first;
+    }
+  // the members follow the EventImpl base: m_function, or m_obj (a
+  // pointer or Ptr) and then m_function
+  const char *fields = reinterpret_cast<const char *> (impl) + sizeof (EventImpl);
+  if (kind->second == 1)
+    {
+      const void *function;
+      std::memcpy (&function, fields, sizeof (function));
+      return function;
+    }
+  if (kind->second == 2)
+    {
+      // Itanium member function pointer: { ptr, adj }, where an odd ptr
+      // is 1 + the vtable offset of a virtual function
+      const char *obj;
+      uintptr_t member[2];
+      std::memcpy (&obj, fields, sizeof (obj));
+      std::memcpy (member, fields + sizeof (obj), sizeof (member));
+      if ((member[0] & 1) == 0)
+        {
+          return reinterpret_cast<const void *> (member[0]);
+        }
+      if (obj == NULL)
+        {
+          return NULL;
+        }
+      const char *vtable;
+      std::memcpy (&vtable, obj + member[1], sizeof (vtable));
+      const void *function;
+      std::memcpy (&function, vtable + member[0] - 1, sizeof (function));
+      return function;
+    }
+  return NULL;
+}
+
+std::string
+ProfilingScheduler::GetTargetName (const EventTarget & target)
+{
+  Dl_info info;
+  int status = -1;
+  char *demangled = NULL;
+  if (target.second != NULL && dladdr (target.second, &info) != 0
+      && info.dli_sname != NULL && info.dli_saddr == target.second)
+    {
+      demangled = abi::__cxa_demangle (info.dli_sname, NULL, NULL, &status);
+      std::string name = status == 0 ? demangled : info.dli_sname;
+      std::free (demangled);
+      return name;
+    }
+  demangled = abi::__cxa_demangle (target.first, NULL, NULL, &status);
+  std::ostringstream name;
+  name << (status == 0 ? demangled : target.first);
+  std::free (demangled);
+  if (target.second != NULL)
+    {
+      name << " @" << target.second;
+    }
+  return name.str ();
+}
+
+void
+ProfilingScheduler::Insert (const Event &ev)
+{
+  m_inner->Insert (ev);
+}
+
+bool
+ProfilingScheduler::IsEmpty (void) const
+{
+  Close ();
+  return m_inner->IsEmpty ();
+}
+
+Scheduler::Event
+ProfilingScheduler::PeekNext (void) const
+{
+  return m_inner->PeekNext ();
+}
+
+Scheduler::Event
+ProfilingScheduler::RemoveNext (void)
+{
+  Close ();
+  Event ev = m_inner->RemoveNext ();
+  if (m_enabled)
+    {
+      m_pending = true;
+      const char *type = typeid (*ev.impl).name ();
+      m_pendingTarget = EventTarget (type, GetTarget (ev.impl, type));
+      clock_gettime (CLOCK_MONOTONIC, &m_pendingStart);
+    }
+  return ev;
+}
+
+void
+ProfilingScheduler::Remove (const Event &ev)
+{
+  m_inner->Remove (ev);
+}
+
+bool
+ProfilingScheduler::WriteReport (std::string fileName)
+{
+  ProfilingScheduler *self = g_active;
+  if (self == NULL)
+    {
+      return false;
+    }
+  self->Close ();
+  self->m_enabled = false;
+
+  std::vector<std::pair<double, EventTarget> > order;
+  double totalNs = 0;
+  for (std::map<EventTarget, EventStats>::const_iterator i = self->m_stats.begin ();
+       i != self->m_stats.end (); ++i)
+    {
+      order.push_back (std::make_pair (i->second.totalNs, i->first));
+      totalNs += i->second.totalNs;
+    }
+  std::sort (order.rbegin (), order.rend ());
+
+  std::ofstream out (fileName.c_str ());
+  out << "# share%\tcount\ttotalMs\tmeanUs\tp50Us\tp99Us\tevent\n";
+  for (uint32_t i = 0; i < order.size (); i++)
+    {
+      const EventStats & stats = self->m_stats[order[i].second];
+      // percentiles at histogram bucket resolution (upper bucket bound)
+      double p50 = 0;
+      double p99 = 0;
+      uint64_t seen = 0;
+      for (uint32_t b = 0; b < 32; b++)
+        {
+          seen += stats.histogram[b];
+          if (p50 == 0 && seen * 2 >= stats.count)
+            {
+              p50 = std::ldexp (1.0, b + 1) / 1000;
+            }
+          if (p99 == 0 && seen * 100 >= stats.count * 99)
+            {
+              p99 = std::ldexp (1.0, b + 1) / 1000;
+            }
+        }
+      out << (totalNs > 0 ? 100 * stats.totalNs / totalNs : 0) << "\t"
+          << stats.count << "\t"
+          << stats.totalNs / 1e6 << "\t"
+          << stats.totalNs / stats.count / 1000 << "\t"
+          << p50 << "\t"
+          << p99 << "\t"
+          << GetTargetName (order[i].second) << "\n";
+    }
+  return true;
+}
+
+class WifiApp
+{
+public:
+  /**
+   * \brief Constructor
+   * \return none
+   */
+  WifiApp ();
+
+  /**
+   * \brief Destructor
+   * \return none
+   */
+  virtual ~WifiApp ();
+
+  /**
+   * \brief Enacts simulation of an ns-3 wifi application
+   * \param argc program arguments count
+   * \param argv program arguments
+   * \return none
+   */
+  void Simulate (int argc, char **argv);
+
+protected:
+  /**
+   * \brief Sets default attribute values
+   * \return none
+   */
+  virtual void SetDefaultAttributeValues ();
+
+  /**
+   * \brief Process command line arguments
+   * \param argc program arguments count
+   * \param argv program arguments
+   * \return none
+   */
+  virtual void ParseCommandLineArguments (int argc, char **argv);
+
+  /**
+   * \brief Configure nodes
+   * \return none
+   */
+  virtual void ConfigureNodes ();
+
+  /**
+   * \brief Configure channels
+   * \return none
+   */
+  virtual void ConfigureChannels ();
+
+  /**
+   * \brief Configure devices
+   * \return none
+   */
+  virtual void ConfigureDevices ();
+
+  /**
+   * \brief Configure mobility
+   * \return none
+   */
+  virtual void ConfigureMobility ();
+
+  /**
+   * \brief Configure applications
+   * \return none
+   */
+  virtual void ConfigureApplications ();
+
+  /**
+   * \brief Configure tracing
+   * \return none
+   */
+  virtual void ConfigureTracing ();
+
+  /**
+   * \brief Run the simulation
+   * \return none
+   */
+  virtual void RunSimulation ();
+
+  /**
+   * \brief Process outputs
+   * \return none
+   */
+  virtual void ProcessOutputs ();
+
+  /**
+   * \brief Sets the JSON file the per-phase profile of Simulate is
+   * written to; an empty name disables the report
+   * \param fileName the report file
+   * \return none
+   */
+  void SetPhaseReportFile (std::string fileName);
+
+  /**
+   * \brief Returns the JSON file of the per-phase profile
+   * \return the report file, empty if disabled
+   */
+  std::string GetPhaseReportFile () const;
+
+private:
+  /**
+   * \brief Cost of one Simulate phase
+   */
+  struct PhaseProfile
+  {
+    std::string name;
+    double wallMs;
+    long peakRssKb;
+    long peakRssDeltaKb;
+    bool counted;          // false once the simulator is destroyed
+    uint32_t nodes;
+    uint32_t devices;
+    uint32_t applications;
+  };
+
+  /**
+   * \brief Records the start of a phase
+   * \return none
+   */
+  void BeginPhase ();
+
+  /**
+   * \brief Records the cost of the phase started by BeginPhase
+   * \param name the phase name
+   * \param count count nodes, devices and applications; must be false
+   * after Simulator::Destroy, which counting would undo
+   * \return none
+   */
+  void EndPhase (std::string name, bool count);
+
+  /**
+   * \brief Writes the recorded phases as JSON
+   * \return none
+   */
+  void WritePhaseReport ();
+
+  std::string m_phaseReportFile;
+  std::vector<PhaseProfile> m_phases;
+  double m_phaseStartMs;
+  long m_phaseStartRssKb;
+};
+
+WifiApp::WifiApp ()
+  : m_phaseStartMs (0),
+    m_phaseStartRssKb (0)
+{
+}
+
+WifiApp::~WifiApp ()
+{
+}
+
+void
+WifiApp::Simulate (int argc, char **argv)
+{
+  // Simulator Program Flow:
+  // (source:  NS-3 Annual Meeting, May, 2014, session 2 slides 6, 28)
+  //   (HandleProgramInputs:)
+  //   SetDefaultAttributeValues
+  //   ParseCommandLineArguments
+  //   (ConfigureTopology:)
+  //   ConfigureNodes
+  //   ConfigureChannels
+  //   ConfigureDevices
+  //   ConfigureMobility
+  //   ConfigureApplications
+  //     e.g AddInternetStackToNodes
+  //         ConfigureIpAddressingAndRouting
+  //         configureSendMessages
+  //   ConfigureTracing
+  //   RunSimulation
+  //   ProcessOutputs
+
+  m_phases.clear ();
+  BeginPhase ();
+  SetDefaultAttributeValues ();
+  EndPhase ("SetDefaultAttributeValues", true);
+  ParseCommandLineArguments (argc, argv);
+  EndPhase ("ParseCommandLineArguments", true);
+  ConfigureNodes ();
+  EndPhase ("ConfigureNodes", true);
+  ConfigureChannels ();
+  EndPhase ("ConfigureChannels", true);
+  ConfigureDevices ();
+  EndPhase ("ConfigureDevices", true);
+  ConfigureMobility ();
+  EndPhase ("ConfigureMobility", true);
+  ConfigureApplications ();
+  EndPhase ("ConfigureApplications", true);
+  ConfigureTracing ();
+  EndPhase ("ConfigureTracing", true);
+  RunSimulation ();
+  EndPhase ("RunSimulation", false);
+  ProcessOutputs ();
+  EndPhase ("ProcessOutputs", false);
+  WritePhaseReport ();
+}
+
+void
+WifiApp::SetPhaseReportFile (std::string fileName)
+{
+  m_phaseReportFile = fileName;
+}
+
+std::string
+WifiApp::GetPhaseReportFile () const
+{
+  return m_phaseReportFile;
+}
+
+void
+WifiApp::BeginPhase ()
+{
+  m_phaseStartMs = WallClockMs ();
+  m_phaseStartRssKb = PeakRssKb ();
+}
+
+void
+WifiApp::EndPhase (std::string name, bool count)
+{
+  PhaseProfile phase;
+  phase.name = name;
+  phase.wallMs = WallClockMs () - m_phaseStartMs;
+  phase.peakRssKb = PeakRssKb ();
+  phase.peakRssDeltaKb = phase.peakRssKb - m_phaseStartRssKb;
+  phase.counted = count;
+  phase.nodes = 0;
+  phase.devices = 0;
+  phase.applications = 0;
+  if (count)
+    {
+      for (NodeList::Iterator i = NodeList::Begin (); i != NodeList::End (); ++i)
+        {
+          phase.nodes++;
+          phase.devices += (*i)->GetNDevices ();
+          phase.applications += (*i)->GetNApplications ();
+        }
+    }
+  m_phases.push_back (phase);
+  // the next phase starts where this one ended
+  BeginPhase ();
+}
+
+void
+WifiApp::WritePhaseReport ()
+{
+  if (m_phaseReportFile.empty ())
+    {
+      return;
+    }
+  std::ofstream out (m_phaseReportFile.c_str ());
+  double totalMs = 0;
+  out << "{\n  \"phases\": [\n";
+  for (uint32_t i = 0; i < m_phases.size (); i++)
+    {
+      const PhaseProfile & phase = m_phases[i];
+      totalMs += phase.wallMs;
+      out << "    { \"name\": \"" << phase.name << "\""
+          << ", \"wallMs\": " << phase.wallMs
+          << ", \"peakRssKb\": " << phase.peakRssKb
+          << ", \"peakRssDeltaKb\": " << phase.peakRssDeltaKb;
+      if (phase.counted)
+        {
+          out << ", \"nodes\": " << phase.nodes
+              << ", \"devices\": " << phase.devices
+              << ", \"applications\": " << phase.applications;
+        }
+      out << " }" << (i + 1 < m_phases.size () ? "," : "") << "\n";
+    }
+  out << "  ],\n  \"totalWallMs\": " << totalMs << "\n}\n";
+}
+
+void
+WifiApp::SetDefaultAttributeValues ()
+{
+}
+
+void
+WifiApp::ParseCommandLineArguments (int argc, char **argv)
+{
+}
+
+void
+WifiApp::ConfigureNodes ()
+{
+}
+
+void
+WifiApp::ConfigureChannels ()
+{
+}
+
+void
+WifiApp::ConfigureDevices ()
+{
+}
+
+void
+WifiApp::ConfigureMobility ()
+{
+}
+
+void
+WifiApp::ConfigureApplications ()
+{
+}
+
+void
+WifiApp::ConfigureTracing ()
+{
+}
+
+void
+WifiApp::RunSimulation ()
+{
+}
+
+void
+WifiApp::ProcessOutputs ()
+{
+}
+
+/**
+ * \brief Concatenates CSV files sharing a header into one file, in
+ * order, keeping a single header line; the parts are removed
+ * \param csvFileName the merged output file
+ * \param parts the part files
+ * \param succeeded whether each part is complete
+ * \return true if every part was merged
+ */
+static bool
+MergeCsvParts (std::string csvFileName, const std::vector<std::string> & parts,
+               const std::vector<bool> & succeeded)
+{
+  std::ofstream out (csvFileName.c_str ());
+  bool header = false;
+  bool ok = true;
+  for (uint32_t i = 0; i < parts.size (); i++)
+    {
+      std::ifstream in (parts[i].c_str ());
+      if (!succeeded[i] || !in)
+        {
+          ok = false;
+          continue;
+        }
+      std::string line;
+      bool first = true;
+      while (std::getline (in, line))
+        {
+          if (first && header)
+            {
+              first = false;
+              continue;
+            }
+          first = false;
+          header = true;
+          out << line << "\n";
+        }
+      in.close ();
+      std::remove (parts[i].c_str ());
+    }
+  out.close ();
+  return ok;
+}
+
+class Experiment : public WifiApp
+{
+public:
+  /**
+   * \brief Constructor
+   * \return none
+   */
+  Experiment ();
+
+  ~Experiment();
+
+  /**
+   * \brief Appends a suffix to every per-run output file but
+   * CSVfileName, so concurrent sweep workers don't share them
+   * \param suffix the suffix, e.g. ".part3"
+   * \return none
+   */
+  void SetOutputSuffix (std::string suffix);
+
+protected:
+  /**
+   * \brief Sets default attribute values
+   * \return none
+   */
+  virtual void SetDefaultAttributeValues ();
+
+  /**
+   * \brief Process command line arguments
+   * \param argc program arguments count
+   * \param argv program arguments
+   * \return none
+   */
+  virtual void ParseCommandLineArguments (int argc, char **argv);
+
+  /**
+   * \brief Configure nodes
+   * \return none
+   */
+  virtual void ConfigureNodes ();
+
+  /**
+   * \brief Configure channels
+   * \return none
+   */
+  virtual void ConfigureChannels ();
+
+  /**
+   * \brief Configure devices
+   * \return none
+   */
+  virtual void ConfigureDevices ();
+
+  /**
+   * \brief Configure mobility
+   * \return none
+   */
+  virtual void ConfigureMobility ();
+
+  /**
+   * \brief Configure applications
+   * \return none
+   */
+  virtual void ConfigureApplications ();
+
+  /**
+   * \brief Configure tracing
+   * \return none
+   */
+  virtual void ConfigureTracing ();
+
+  /**
+   * \brief Run the simulation
+   * \return none
+   */
+  virtual void RunSimulation ();
+
+  /**
+   * \brief Process outputs
+   * \return none
+   */
+  virtual void ProcessOutputs ();
+
+private:
+  /**
+   * \brief Run the simulation
+   * \return none
+   */
+  void Run ();
+
+  /**
+   * \brief Run the simulation
+   * \return none
+   */
+  void CommandSetup (int argc, char **argv);
+
+  /**
+   * \brief Checks the throughput and outputs summary to CSV file2.
+   * This is scheduled and called once per throughput interval; it
+   * reads and resets the per-interval RoutingStats counters
+   * \return none
+   */
+  void CheckThroughput ();
+
+  /**
+   * \brief Forks one process per warm-up variant.  Scheduled at the
+   * warm-up time; every child applies its variant and continues the
+   * run from the shared warmed-up state, while the parent waits for
+   * the children, merges their summary rows and stops
+   * \return none
+   */
+  void ForkVariants ();
+
+  /**
+   * \brief Applies a warm-up variant in a forked child
+   * \param variant index of the variant
+   * \param settings the traffic parameters of the variant
+   * \return none
+   */
+  void ApplyVariant (uint32_t variant, const std::vector<std::pair<std::string, std::string> > & settings);
+
+  /**
+   * \brief Set up log file
+   * \return none
+   */
+  void SetupLogFile ();
+
+  /**
+   * \brief Set up logging
+   * \return none
+   */
+  void SetupLogging ();
+
+  /**
+   * \brief Configure default attributes
+   * \return none
+   */
+  void ConfigureDefaults ();
+
+  /**CommandLine cmd;
+   * \brief Set up the adhoc mobility nodes
+   * \return none
+   */
+//   void SetupAdhocMobilityNodes ();
+
+  /**
+   * \brief Set up the adhoc devices
+   * \return none
+   */
+//   void SetupAdhocDevices ();
+
+  /**
+   * \brief Set up generation of IEEE 1609 WAVE messages,
+   * as a Basic Safety Message (BSM).  The BSM is typically
+   * a ~200-byte packets broadcast by all vehicles at a nominal
+   * rate of 10 Hz
+   * \return none
+   */
+//   void SetupWaveMessages ();
+
+  /**
+   * \brief Set up generation of packets to be routed
+   * through the vehicular network
+   * \return none
+   */
+  void SetupRoutingMessages ();
+
+  /**
+   * \brief Set up a prescribed scenario
+   * \return none
+   */
+  void SetupScenario ();
+
+  /**
+   * \brief Creates the NetAnim output selected by m_animMode
+   * \return the animation interface, or NULL if disabled
+   */
+  AnimationInterface * SetupAnimation ();
+
+  /**
+   * \brief Creates the configured propagation loss model chain
+   * \return the propagation loss model of the shared channel
+   */
+  Ptr<PropagationLossModel> CreateLossModel ();
+
+  /**
+   * \brief Write the header line to the CSV file1, truncating it
+   * \return none
+   */
+  void WriteCsvHeader ();
+
+  /**
+   * \brief Set up configuration parameter from the global variables
+   * \return none
+   */
+//   void SetConfigFromGlobals ();
+
+//   /**
+//    * \brief Set up the global variables from the configuration parameters
+//    * \return none
+//    */
+//   void SetGlobalsFromConfig ();
+
+  static void
+  CourseChange (MobilityTraceLogger *logger, std::string foo, Ptr<const MobilityModel> mobility);
+
+  uint32_t m_port;
+  std::string m_CSVfileName;
+  std::string m_CSVfileName2;
+  std::ofstream m_throughputOs;
+  double m_throughputInterval; // s
+  uint32_t m_nSinks;
+  std::string m_protocolName;
+  double m_txp;
+  bool m_traceMobility;
+  std::string m_mobilityTraceFile;
+  MobilityTraceLogger m_mobilityTrace;
+  uint32_t m_protocol;
+
+  uint32_t m_lossModel;
+  uint32_t m_fading;
+  std::string m_lossModelName;
+  bool m_rangeCull;
+  double m_rangeCullMargin; // dB below the noise floor
+  Ptr<RangeCulledPropagationLossModel> m_rangeCulledLoss;
+  bool m_lossCache;
+  double m_lossCacheResolution; // m
+  Ptr<CachedPropagationLossModel> m_cachedLoss;
+  uint32_t m_packetSize;        // OnOff packet size (bytes)
+  uint32_t m_allocStats;        // 0=off, 1=count allocations in Run, 2=also time them
+  uint32_t m_phyFidelity;       // 0=full error rate model, 1=PER tables
+  double m_runWallMs;           // wall time of Simulator::Run
+  double m_warmup;              // s, fork the variants at this time, 0=off
+  std::string m_warmupVariants; // e.g. "rate=2048bps,8kbps;packetSize=64,512"
+  uint32_t m_warmupJobs;        // concurrent variants, 0=one per core
+  double m_measureStart;        // s, start of the summary measurement
+  bool m_warmupParent;          // the variants wrote the summary
+
+  std::string m_logFile;
+  uint32_t m_mobility;
+  std::string m_waypointFile;
+  uint32_t m_nNodes;
+  uint32_t m_nBase; //no of Base stations
+  double m_TotalSimTime;
+  std::string m_rate;
+  std::string m_trName;
+  std::string m_scheduler;      // map, list, heap, calendar, ladder or a TypeId name
+  std::string m_schedulerTrace; // record the scheduler operations, empty=off
+  std::string m_eventProfile;   // event profile report, empty=off
+  int m_traceBinding;           // 0=Config::Connect wildcards, 1=direct
+  double m_statsBucket;         // s
+  std::string m_statsFile;      // per-node history, .bin for binary, else CSV
+  uint32_t m_animMode;          // 0=off, 1=single file, 2=chunked and compressed
+  std::string m_animFile;
+  std::string m_outputSuffix;   // appended to the per-run outputs after parsing
+  uint64_t m_animChunkPkts;     // packet records per chunk
+  bool m_animPackets;           // write packet records at all
+  double m_animStart;           // s
+  double m_animStop;            // s, 0=end of simulation
+  double m_animMobilityPoll;    // s
+  AnimationChunkCompressor m_animCompressor;
+  int m_nodeSpeed; //in m/s
+  int m_nodePause; //in s
+  int m_verbose;
+  std::ofstream m_os;
+  NetDeviceContainer m_TxDevices;
+  NetDeviceContainer m_baseDevices;
+  NetDeviceContainer m_allDevices;
+  Ipv4InterfaceContainer m_TxInterfaces;
+  Ipv4InterfaceContainer m_baseInterfaces;
+  Ipv4InterfaceContainer m_allInterfaces;
+  uint32_t m_macMode;
+  double m_stdmaFrameDuration;  // s
+  uint32_t m_stdmaReportRate;   // reports per frame
+  uint32_t m_stdmaMaxPacketSize;
+  double m_stdmaSelectionInterval; // fraction of the nominal increment
+  uint32_t m_stdmaMinCandidates;
+  uint32_t m_stdmaTimeoutMin;   // frames
+  uint32_t m_stdmaTimeoutMax;   // frames
+  int m_routingTables;
+  int m_asciiTrace;
+  int m_pcap;
+  double m_freq; //0 5.8Ghz 1 2.4Ghz
+  double m_baseAntennaHeight; //Base station Height 
+  double m_baseAntennaGain;
+  double m_nodeAntennaGain;
+  double m_nodeAntennaHeight;
+ 
+  Ptr<RoutingHelper> m_routingHelper;
+  Ptr<FlowMonitor> m_monitor;
+  int m_log;
+  // used to get consistent random numbers across scenarios
+  int64_t m_streamIndex;
+  NodeContainer m_TxNodes;
+  NodeContainer m_baseNodes;
+  NodeContainer m_allNodes;
+  std::string m_exp;
+  int m_cumulativeCaptureStart;
+  FlowMonitorHelper m_flowmon;
+};
+
+Experiment::Experiment()
+  : m_port (9),
+    m_CSVfileName ("experiment.output.csv"),
+    m_CSVfileName2 ("experiment.output2.csv"),
+    m_throughputInterval (1.0),
+    m_nSinks (5),
+    m_protocolName ("protocol"),
+    m_traceMobility (false),
+    m_mobilityTraceFile ("experiment.mobility.bin"),
+    // Differnt Routing Protocls
+    m_protocol (2),
+    // Different Loss models
+    m_lossModel (1),
+    m_fading (0),
+    m_lossModelName (""),
+    m_rangeCull (false),
+    m_rangeCullMargin (20.0),
+    m_lossCache (false),
+    m_lossCacheResolution (1.0),
+    m_packetSize (64),
+    m_allocStats (0),
+    m_phyFidelity (0),
+    m_runWallMs (0),
+    m_warmup (0),
+    m_warmupVariants (""),
+    m_warmupJobs (0),
+    m_measureStart (0),
+    m_warmupParent (false),
+    m_logFile ("low_ct-unterstrass-1day.filt.5.adj.log"),
+    m_mobility (2),
+    m_waypointFile (""),
+    m_nNodes (10),
+    m_nBase(1),
+    m_TotalSimTime (300),
+    //OnoffApplication frequency
+    m_rate ("2048bps"),
+    m_trName ("experiment-compare"),
+    m_scheduler ("map"),
+    m_schedulerTrace (""),
+    m_eventProfile (""),
+    m_traceBinding (1),
+    m_statsBucket (1.0),
+    m_statsFile (""),
+    m_animMode (1),
+    m_animFile ("experiment.xml"),
+    m_outputSuffix (""),
+    m_animChunkPkts (100000),
+    m_animPackets (true),
+    m_animStart (0),
+    m_animStop (0),
+    m_animMobilityPoll (0.25),
+    m_nodeSpeed (50),
+    m_nodePause (0),
+    m_verbose (0),
+    m_macMode (0),
+    m_stdmaFrameDuration (1.0),
+    m_stdmaReportRate (10),
+    m_stdmaMaxPacketSize (400),
+    m_stdmaSelectionInterval (0.2),
+    m_stdmaMinCandidates (4),
+    m_stdmaTimeoutMin (8),
+    m_stdmaTimeoutMax (8),
+    m_routingTables (0),
+    m_asciiTrace (0),
+    m_pcap (0),
+    m_log (1),
+    m_streamIndex (0),
+    m_TxNodes (),
+    m_exp (""),
+    m_cumulativeCaptureStart (0),
+    m_freq(5.8e9),
+    m_baseAntennaHeight(50),
+    m_nodeAntennaHeight(9),
+    m_baseAntennaGain(18.6),
+    m_nodeAntennaGain(14.6),
+    m_allNodes()
+    
+{
+
+  m_routingHelper = CreateObject<RoutingHelper> ();
+  m_log = 1;
+}
+Experiment::~Experiment ()
+{
+}
+void Experiment::ParseCommandLineArguments(int argc, char** argv){
+
+  CommandLine cmd;
+
+  cmd.AddValue ("totaltime", "Simulation end time", m_TotalSimTime);
+  cmd.AddValue ("nodes", "Number of nodes (i.e. vehicles)", m_nNodes);
+  cmd.AddValue ("sinks", "Number of routing sinks", m_nSinks);
+  cmd.AddValue ("traceMobility", "Enable mobility tracing", m_traceMobility);
+  cmd.AddValue ("mobilityTraceFile", "Binary mobility trace (see --convertMobilityTrace)", m_mobilityTraceFile);
+  cmd.AddValue ("protocol", "1=OLSR;2=AODV;3=DSDV;4=DSR", m_protocol);
+  cmd.AddValue ("lossModel", "1=Friis;2=ItuR1411Los;3=TwoRayGround;4=LogDistance", m_lossModel);
+  cmd.AddValue ("fading", "0=None;1=Nakagami;(buildings=1 overrides)", m_fading);
+  cmd.AddValue ("rangeCull", "Skip loss computation for links far below the noise floor", m_rangeCull);
+  cmd.AddValue ("rangeCullMargin", "Cull links this many dB below the noise floor", m_rangeCullMargin);
+  cmd.AddValue ("lossCache", "Cache the loss of links to stationary base stations", m_lossCache);
+  cmd.AddValue ("lossCacheResolution", "Mobile position quantization (m) of the loss cache", m_lossCacheResolution);
+  cmd.AddValue ("logFile", "Log file", m_logFile);
+  cmd.AddValue ("mobility", "1=RandomWalk2d;2=RandomWayPoint;3=replayed RandomWayPoint trace;4=batched RandomWayPoint", m_mobility);
+  cmd.AddValue ("waypointFile", "Waypoint trace of mobility=3, generated if missing or stale; default named after the scenario", m_waypointFile);
+  cmd.AddValue ("rate", "Rate", m_rate);
+  cmd.AddValue ("speed", "Node speed (m/s)", m_nodeSpeed);
+  cmd.AddValue ("pause", "Node pause (s)", m_nodePause);
+  cmd.AddValue ("verbose", "0=quiet;1=verbose", m_verbose);
+  cmd.AddValue ("macMode", "0=CSMA, 1=TDMA", m_macMode);
+  cmd.AddValue ("stdmaFrameDuration", "STDMA frame duration (s)", m_stdmaFrameDuration);
+  cmd.AddValue ("stdmaReportRate", "STDMA position reports per frame", m_stdmaReportRate);
+  cmd.AddValue ("stdmaMaxPacketSize", "STDMA maximum packet size (bytes)", m_stdmaMaxPacketSize);
+  cmd.AddValue ("stdmaSelectionInterval", "STDMA selection interval, fraction of the nominal increment", m_stdmaSelectionInterval);
+  cmd.AddValue ("stdmaMinCandidates", "STDMA minimum candidate set size", m_stdmaMinCandidates);
+  cmd.AddValue ("stdmaTimeoutMin", "STDMA reservation timeout lower bound (frames)", m_stdmaTimeoutMin);
+  cmd.AddValue ("stdmaTimeoutMax", "STDMA reservation timeout upper bound (frames)", m_stdmaTimeoutMax);
+  cmd.AddValue("baseHeight","Antenna Height for base station in meters",m_baseAntennaHeight);
+  cmd.AddValue("nodeHeight","Antenna Height for Node in meters",m_nodeAntennaHeight);
+  cmd.AddValue("baseGain","Antenna Gain for base station",m_baseAntennaGain);
+  cmd.AddValue("nodeGain","Antenna Gain for ABE",m_nodeAntennaGain);
+  cmd.AddValue("Frequency","Operating frequency in hz",m_freq);
+  cmd.AddValue ("packetSize", "OnOff application packet size (bytes)", m_packetSize);
+  cmd.AddValue ("allocStats", "0=off;1=count heap allocations during Run;2=also time malloc/free", m_allocStats);
+  cmd.AddValue ("phyFidelity", "0=full Nist error rate model;1=precomputed PER tables", m_phyFidelity);
+  cmd.AddValue ("warmup", "Fork the warmupVariants at this time (s), 0=off", m_warmup);
+  cmd.AddValue ("warmupVariants", "Traffic grid run from the warmed-up state, e.g. rate=2048bps,8kbps;packetSize=64,512", m_warmupVariants);
+  cmd.AddValue ("warmupJobs", "Concurrently running warm-up variants, 0=one per core", m_warmupJobs);
+  cmd.AddValue ("scheduler", "Event scheduler: map, list, heap, calendar or ladder", m_scheduler);
+  cmd.AddValue ("schedulerTrace", "Record the scheduler operations for --replaySchedulerTrace", m_schedulerTrace);
+  cmd.AddValue ("eventProfile", "Profile Simulator::Run events by target function into this file", m_eventProfile);
+  cmd.AddValue ("traceBinding", "0=Config::Connect wildcard paths;1=connect on installed objects", m_traceBinding);
+  cmd.AddValue ("statsBucket", "Width (s) of the per-node statistics buckets", m_statsBucket);
+  cmd.AddValue ("statsFile", "Per-node statistics history (.bin=binary, else CSV)", m_statsFile);
+  cmd.AddValue ("animMode", "0=no NetAnim output;1=single file;2=chunked, gzipped files", m_animMode);
+  cmd.AddValue ("animFile", "NetAnim output file", m_animFile);
+  cmd.AddValue ("animChunkPkts", "Packet records per NetAnim chunk (animMode=2)", m_animChunkPkts);
+  cmd.AddValue ("animPackets", "Write NetAnim packet records", m_animPackets);
+  cmd.AddValue ("animStart", "Start time (s) of NetAnim packet records", m_animStart);
+  cmd.AddValue ("animStop", "Stop time (s) of NetAnim packet records, 0=end", m_animStop);
+  cmd.AddValue ("animMobilityPoll", "NetAnim node position sampling interval (s)", m_animMobilityPoll);
+  std::string phaseReport;
+  cmd.AddValue ("phaseReport", "JSON file for the per-phase time and memory profile", phaseReport);
+  cmd.AddValue ("CSVfileName", "The name of the CSV output file name", m_CSVfileName);
+  cmd.AddValue ("CSVfileName2", "The name of the per-interval CSV output file name", m_CSVfileName2);
+  cmd.AddValue ("throughputInterval", "Throughput sampling interval (s)", m_throughputInterval);
+  cmd.Parse (argc, argv);
+  if (!m_outputSuffix.empty ())
+    {
+      m_CSVfileName2 += m_outputSuffix;
+      m_animFile += m_outputSuffix;
+      m_mobilityTraceFile += m_outputSuffix;
+      if (!m_statsFile.empty ())
+        {
+          m_statsFile += m_outputSuffix;
+        }
+      if (!m_eventProfile.empty ())
+        {
+          m_eventProfile += m_outputSuffix;
+        }
+      if (!m_schedulerTrace.empty ())
+        {
+          m_schedulerTrace += m_outputSuffix;
+        }
+      if (!phaseReport.empty ())
+        {
+          phaseReport += m_outputSuffix;
+        }
+    }
+  SetPhaseReportFile (phaseReport);
+
+  // the rate is only known after parsing
+  Config::SetDefault ("ns3::OnOffApplication::DataRate",  StringValue (m_rate));
+  Config::SetDefault ("ns3::OnOffApplication::PacketSize", UintegerValue (m_packetSize));
+
+  // forked variants get neither the writer threads nor their own
+  // NetAnim file, and would share the scheduler trace FILE
+  NS_ABORT_MSG_IF (m_warmup > 0 && (m_traceMobility || m_animMode != 0 || !m_schedulerTrace.empty ()),
+                   "warmup cannot be combined with traceMobility, animMode or schedulerTrace");
+
+  // both wrap the scheduler, and only one can
+  NS_ABORT_MSG_IF (!m_schedulerTrace.empty () && !m_eventProfile.empty (),
+                   "eventProfile cannot be combined with schedulerTrace");
+
+  ObjectFactory scheduler;
+  if (!m_schedulerTrace.empty ())
+    {
+      scheduler.SetTypeId ("ns3::RecordingScheduler");
+      scheduler.Set ("Inner", StringValue (SchedulerTypeId (m_scheduler)));
+      scheduler.Set ("TraceFile", StringValue (m_schedulerTrace));
+    }
+  else if (!m_eventProfile.empty ())
+    {
+      scheduler.SetTypeId ("ns3::ProfilingScheduler");
+      scheduler.Set ("Inner", StringValue (SchedulerTypeId (m_scheduler)));
+    }
+  else
+    {
+      scheduler.SetTypeId (SchedulerTypeId (m_scheduler));
+    }
+  Simulator::SetScheduler (scheduler);
+}
+
+void Experiment::ConfigureNodes(){
+  m_TxNodes.Create(m_nNodes);
+  m_baseNodes.Create(m_nBase);
+  for(uint32_t i=0;i<m_nBase;i++){
+    m_allNodes.Add(m_baseNodes.Get(i));
+  }
+  for(uint32_t i=0;i<m_nNodes;i++){
+    m_allNodes.Add(m_TxNodes.Get(i));
+  }
+}
+
+void Experiment::ConfigureChannels(){
+
+  if (m_lossModel == 1)
+    {
+      m_lossModelName = "ns3::FriisPropagationLossModel";
+    }
+  else if (m_lossModel == 2)
+    {
+      m_lossModelName = "ns3::ItuR1411LosPropagationLossModel";
+    }
+  else if (m_lossModel == 3)
+    {
+      m_lossModelName = "ns3::TwoRayGroundPropagationLossModel";
+    }
+  else if (m_lossModel == 4)
+    {
+      m_lossModelName = "ns3::LogDistancePropagationLossModel";
+    }
+  else
+    {
+      // Unsupported propagation loss model.
+      // Treating as ERROR
+      NS_LOG_ERROR ("Invalid propagation loss model specified.  Values must be [1-4], where 1=Friis;2=ItuR1411Los;3=TwoRayGround;4=LogDistance");
+    }
+  
+  
+  
+  //BaseStationChannel
+  Ptr<YansWifiChannel> Channel = CreateObject<YansWifiChannel> ();
+  Channel->SetPropagationDelayModel (CreateObject<ConstantSpeedPropagationDelayModel> ());
+  Channel->SetPropagationLossModel (CreateLossModel ());
+  
+
+  YansWifiPhyHelper basePhy = YansWifiPhyHelper::Default();
+  basePhy.SetChannel(Channel);
+  
+  YansWifiPhyHelper nodePhy = YansWifiPhyHelper::Default();
+  nodePhy.SetChannel(Channel);
+
+  if (m_phyFidelity == 1)
+    {
+      basePhy.SetErrorRateModel ("ns3::TableErrorRateModel");
+      nodePhy.SetErrorRateModel ("ns3::TableErrorRateModel");
+    }
+
+  basePhy.SetPcapDataLinkType (YansWifiPhyHelper::DLT_IEEE802_11); //Tracing Stuff
+  nodePhy.SetPcapDataLinkType (YansWifiPhyHelper::DLT_IEEE802_11);
+
+  WifiHelper wifi;
+  if(m_verbose){
+    wifi.EnableLogComponents();
+  }
+
+
+  basePhy.Set("TxGain",DoubleValue(m_baseAntennaGain));
+  nodePhy.Set("TxGain",DoubleValue(m_nodeAntennaGain));
+
+  wifi.SetRemoteStationManager ("ns3::ConstantRateWifiManager");
+
+
+  //Configuring the mac_layer
+  if(m_macMode == 0){
+    NqosWifiMacHelper wifiMac = NqosWifiMacHelper::Default ();
+    Ssid ssid = Ssid("base-station");
+    wifiMac.SetType ("ns3::StaWifiMac",
+                "Ssid", SsidValue (ssid),
+                "ActiveProbing", BooleanValue (false));
+
+    m_TxDevices = wifi.Install(nodePhy,wifiMac,m_TxNodes);
+
+    wifiMac.SetType("ns3::ApWifiMac","Ssid",SsidValue(ssid));
+
+    m_baseDevices = wifi.Install(basePhy,wifiMac,m_baseNodes);
+
+  }
+  else if(m_macMode == 1){
+    // Self-organized TDMA; there is no association, every device
+    // reserves its own slots in the frame
+    Config::SetDefault ("stdma::StdmaMac::FrameDuration", TimeValue (Seconds (m_stdmaFrameDuration)));
+    Config::SetDefault ("stdma::StdmaMac::MaximumPacketSize", UintegerValue (m_stdmaMaxPacketSize));
+    Config::SetDefault ("stdma::StdmaMac::ReportRate", UintegerValue (m_stdmaReportRate));
+    Config::SetDefault ("stdma::StdmaMac::SelectionIntervalRatio", DoubleValue (m_stdmaSelectionInterval));
+    Config::SetDefault ("stdma::StdmaMac::MinimumCandidateSetSize", UintegerValue (m_stdmaMinCandidates));
+    Config::SetDefault ("stdma::StdmaMac::Timeout", RandomVariableValue (UniformVariable (m_stdmaTimeoutMin, m_stdmaTimeoutMax)));
+
+    stdma::StdmaHelper stdma;
+    stdma.SetStandard (WIFI_PHY_STANDARD_80211p_CCH);
+    stdma::StdmaMacHelper stdmaMac = stdma::StdmaMacHelper::Default ();
+
+    m_TxDevices = stdma.Install (nodePhy, stdmaMac, m_TxNodes);
+    m_baseDevices = stdma.Install (basePhy, stdmaMac, m_baseNodes);
+  }
+  
+ if (m_asciiTrace != 0)
+    {
+      AsciiTraceHelper ascii;
+      Ptr<OutputStreamWrapper> osw = ascii.CreateFileStream ( (m_trName +  "-base.tr").c_str ());
+      Ptr<OutputStreamWrapper> osw1 = ascii.CreateFileStream ( (m_trName +  "-sta.tr").c_str ());
+      basePhy.EnableAsciiAll (osw);
+      nodePhy.EnableAsciiAll (osw1);
+    }
+  if (m_pcap != 0)
+    {
+      basePhy.EnablePcapAll ("base-station-pcap");
+      nodePhy.EnablePcapAll ("node-pcap");
+    }
+
+  for(uint32_t i=0;i<m_nBase;i++){
+    m_allDevices.Add(m_baseDevices.Get(i));
+  }
+  for(uint32_t i=0;i<m_nNodes;i++){
+    m_allDevices.Add(m_TxDevices.Get(i));
+  }
+
+}
+
+AnimationInterface *
+Experiment::SetupAnimation ()
+{
+  if (m_animMode == 0)
+    {
+      return NULL;
+    }
+  AnimationInterface *anim = new AnimationInterface (m_animFile);
+  anim->SetMobilityPollInterval (Seconds (m_animMobilityPoll));
+  if (!m_animPackets)
+    {
+      anim->SkipPacketTracing ();
+    }
+  anim->SetStartTime (Seconds (m_animStart));
+  if (m_animStop > 0)
+    {
+      anim->SetStopTime (Seconds (m_animStop));
+    }
+  if (m_animMode == 1)
+    {
+      anim->SetMaxPktsPerTraceFile (50000000);
+    }
+  else
+    {
+      anim->SetMaxPktsPerTraceFile (m_animChunkPkts);
+      m_animCompressor.Start (m_animFile, Seconds (1.0));
+    }
+  return anim;
+}
+
+Ptr<PropagationLossModel>
+Experiment::CreateLossModel ()
+{
+  ObjectFactory factory;
+  factory.SetTypeId (m_lossModelName);
+  if (m_lossModel != 4)
+    {
+      // LogDistance has no frequency attribute
+      factory.Set ("Frequency", DoubleValue (m_freq));
+    }
+  if (m_lossModel == 3)
+    {
+      // two-ray requires antenna height (else defaults to Friss)
+      factory.Set ("HeightAboveZ", DoubleValue (m_baseAntennaHeight));
+    }
+  Ptr<PropagationLossModel> loss = factory.Create<PropagationLossModel> ();
+
+  if (m_lossCache)
+    {
+      m_cachedLoss = CreateObject<CachedPropagationLossModel> ();
+      m_cachedLoss->SetAttribute ("Resolution", DoubleValue (m_lossCacheResolution));
+      m_cachedLoss->SetInner (loss);
+      loss = m_cachedLoss;
+    }
+
+  if (m_rangeCull)
+    {
+      // worst case link budget: strongest transmitter towards the
+      // most sensitive receiver, culled only well below its noise
+      // floor (thermal noise over the narrowest channel in use plus the
+      // noise figure), where a frame no longer counts as interference
+      Ptr<YansWifiPhy> probe = CreateObject<YansWifiPhy> ();
+      DoubleValue txPower;
+      DoubleValue rxGain;
+      DoubleValue noiseFigure;
+      probe->GetAttribute ("TxPowerEnd", txPower);
+      probe->GetAttribute ("RxGain", rxGain);
+      probe->GetAttribute ("RxNoiseFigure", noiseFigure);
+      double txGain = std::max (m_baseAntennaGain, m_nodeAntennaGain);
+      double bandwidth = m_macMode == 1 ? 10e6 : 20e6; // 802.11p CCH or 802.11a
+      double noiseDbm = -174.0 + 10 * std::log10 (bandwidth) + noiseFigure.Get ();
+
+      m_rangeCulledLoss = CreateObject<RangeCulledPropagationLossModel> ();
+      m_rangeCulledLoss->SetInner (loss);
+      double range = m_rangeCulledLoss->SetLinkBudget (txPower.Get () + txGain + rxGain.Get (),
+                                                       noiseDbm - m_rangeCullMargin);
+      NS_LOG_UNCOND ("Culling receivers beyond " << range << " m, below "
+                     << noiseDbm - m_rangeCullMargin << " dBm; each culled frame would have"
+                     << " raised the noise by at most "
+                     << 10 * std::log10 (1 + std::pow (10.0, -m_rangeCullMargin / 10)) << " dB");
+      loss = m_rangeCulledLoss;
+    }
+  return loss;
+}
+
+void Experiment::ConfigureMobility(){
+
+
+  //Stationary base stations
+  MobilityHelper mobility;
+
+  mobility.SetMobilityModel ("ns3::ConstantPositionMobilityModel");
+  mobility.SetPositionAllocator ("ns3::GridPositionAllocator",
+                                    "MinX", DoubleValue (50.0),
+                                    "MinY", DoubleValue (0.0),
+                                    "DeltaX", DoubleValue (5.0),
+                                    "DeltaY", DoubleValue (0.0),
+                                    "GridWidth", UintegerValue (10),
+                                    "LayoutType", StringValue ("RowFirst"));
+  mobility.Install (m_baseNodes);
+
+  m_streamIndex += mobility.AssignStreams (m_baseNodes, m_streamIndex);
+
+
+  std::stringstream ssSpeed;
+  ssSpeed << "ns3::UniformRandomVariable[Min=0.0|Max=" << m_nodeSpeed << "]";
+  std::stringstream ssPause;
+  ssPause << "ns3::ConstantRandomVariable[Constant=" << m_nodePause << "]";
+
+  if(m_mobility == 1){
+    //Random Walk
+    ObjectFactory pos2;
+    pos2.SetTypeId ("ns3::RandomBoxPositionAllocator");
+    pos2.Set ("X", StringValue ("ns3::UniformRandomVariable[Min=0.0|Max=1500.0]"));
+    pos2.Set ("Y", StringValue ("ns3::UniformRandomVariable[Min=10.0|Max=300]"));
+    Ptr<PositionAllocator> nodePositionAlloc = pos2.Create ()->GetObject<PositionAllocator> ();
+    m_streamIndex += nodePositionAlloc->AssignStreams (m_streamIndex);
+
+    mobility.SetMobilityModel ("ns3::RandomWalk2dMobilityModel",
+                            "Bounds", RectangleValue (Rectangle (0, 1500, 10, 1500)),
+                            "PositionAllocator",PointerValue(nodePositionAlloc),
+                            "Speed",StringValue(ssSpeed.str()),
+                            "Distance",DoubleValue(10.0));
+
+    mobility.SetPositionAllocator (nodePositionAlloc);
+
+    mobility.Install(m_TxNodes);
+
+    m_streamIndex += mobility.AssignStreams (m_TxNodes, m_streamIndex);
+
+  
+  }
+  else if(m_mobility == 2){
+    //Random Way Point
+    ObjectFactory pos2;
+    pos2.SetTypeId ("ns3::RandomBoxPositionAllocator");
+    pos2.Set ("X", StringValue ("ns3::UniformRandomVariable[Min=0.0|Max=300.0]"));
+    pos2.Set ("Y", StringValue ("ns3::UniformRandomVariable[Min=10.0|Max=300]"));
+    Ptr<PositionAllocator> nodePositionAlloc = pos2.Create ()->GetObject<PositionAllocator> ();
+    m_streamIndex += nodePositionAlloc->AssignStreams (m_streamIndex);
+
+    mobility.SetMobilityModel ("ns3::RandomWaypointMobilityModel",
+                                      "Speed", StringValue (ssSpeed.str ()),
+                                      "Pause", StringValue (ssPause.str ()),
+                                      "PositionAllocator", PointerValue (nodePositionAlloc));
+
+    mobility.SetPositionAllocator (nodePositionAlloc);
+
+    mobility.Install(m_TxNodes);
+
+    m_streamIndex += mobility.AssignStreams (m_TxNodes, m_streamIndex);
+  }
+  else if(m_mobility == 3){
+    //Random Way Point, precomputed once and replayed
+    WaypointTrace::Parameters parameters;
+    std::memset (&parameters, 0, sizeof (parameters));
+    parameters.nNodes = m_nNodes;
+    parameters.duration = m_TotalSimTime;
+    parameters.minSpeed = 0.0;
+    parameters.maxSpeed = m_nodeSpeed;
+    parameters.pause = m_nodePause;
+    parameters.minX = 0.0;
+    parameters.maxX = 300.0;
+    parameters.minY = 10.0;
+    parameters.maxY = 300.0;
+    parameters.stream = m_streamIndex;
+    m_streamIndex += 3;
+
+    // named after the parameters, so sweep workers with different
+    // scenarios never share a file
+    if (m_waypointFile.empty ())
+      {
+        m_waypointFile = WaypointTrace::DefaultFileName ("experiment", parameters);
+      }
+    Ptr<WaypointTrace> trace = WaypointTrace::Open (m_waypointFile);
+    if (trace != 0 && !WaypointTrace::Matches (trace->GetParameters (), parameters))
+      {
+        trace = 0;
+      }
+    if (trace == 0)
+      {
+        SystemWallClockMs clock;
+        clock.Start ();
+        NS_ABORT_MSG_UNLESS (WaypointTrace::Generate (m_waypointFile, parameters),
+                             "Unable to write " << m_waypointFile);
+        NS_LOG_UNCOND ("Generated " << m_waypointFile << " in " << clock.End () << " ms");
+        trace = WaypointTrace::Open (m_waypointFile);
+        // another process may have replaced the file since Generate
+        NS_ABORT_MSG_UNLESS (trace != 0 && WaypointTrace::Matches (trace->GetParameters (), parameters),
+                             "Unable to map a matching " << m_waypointFile);
+      }
+
+    for (uint32_t i = 0; i < m_nNodes; i++)
+      {
+        Ptr<ReplayMobilityModel> model = CreateObject<ReplayMobilityModel> ();
+        model->SetTrace (trace, i);
+        if (m_traceMobility)
+          {
+            model->EnableCourseChanges ();
+          }
+        m_TxNodes.Get (i)->AggregateObject (model);
+      }
+  }
+  else if(m_mobility == 4){
+    //Random Way Point, all nodes advanced together
+    Ptr<BatchMobilityEngine> engine = Create<BatchMobilityEngine> ();
+    engine->SetBounds (0.0, 300.0, 10.0, 300.0);
+    Ptr<UniformRandomVariable> speed = CreateObject<UniformRandomVariable> ();
+    speed->SetAttribute ("Min", DoubleValue (0.0));
+    speed->SetAttribute ("Max", DoubleValue (m_nodeSpeed));
+    Ptr<ConstantRandomVariable> pause = CreateObject<ConstantRandomVariable> ();
+    pause->SetAttribute ("Constant", DoubleValue (m_nodePause));
+    engine->SetWalk (speed, pause);
+    m_streamIndex += engine->AssignStreams (m_streamIndex);
+
+    Ptr<RandomBoxPositionAllocator> nodePositionAlloc = CreateObject<RandomBoxPositionAllocator> ();
+    nodePositionAlloc->SetAttribute ("X", StringValue ("ns3::UniformRandomVariable[Min=0.0|Max=300.0]"));
+    nodePositionAlloc->SetAttribute ("Y", StringValue ("ns3::UniformRandomVariable[Min=10.0|Max=300]"));
+    m_streamIndex += nodePositionAlloc->AssignStreams (m_streamIndex);
+
+    for (uint32_t i = 0; i < m_nNodes; i++)
+      {
+        Ptr<BatchMobilityModel> model = CreateObject<BatchMobilityModel> ();
+        model->SetEngine (engine);
+        model->SetPosition (nodePositionAlloc->GetNext ());
+        m_TxNodes.Get (i)->AggregateObject (model);
+      }
+  }
+
+  if (m_cachedLoss != 0)
+    {
+      m_cachedLoss->PrecomputeStaticLinks (m_allNodes);
+    }
+
+  if (m_traceMobility && m_mobilityTrace.Open (m_mobilityTraceFile))
+    {
+      SystemWallClockMs clock;
+      clock.Start ();
+      if (m_traceBinding == 0)
+        {
+          Config::Connect ("/NodeList/*/$ns3::MobilityModel/CourseChange",
+                           MakeBoundCallback (&Experiment::CourseChange, &m_mobilityTrace));
+        }
+      else
+        {
+          TraceBinder::ConnectCourseChange (m_allNodes,
+                                            MakeBoundCallback (&Experiment::CourseChange, &m_mobilityTrace));
+        }
+      NS_LOG_UNCOND ("CourseChange binding (" << (m_traceBinding == 0 ? "config" : "direct")
+                     << "): " << clock.End () << " ms");
+    }
+}
+
+void Experiment::ConfigureApplications(){
+  if (!m_statsFile.empty ())
+    {
+      m_routingHelper->EnableHistory (Seconds (m_statsBucket));
+    }
+  m_routingHelper->Install (m_allNodes,
+                          m_allDevices,
+                          m_allInterfaces,
+                          m_TotalSimTime,
+                          m_protocol,
+                          m_nSinks,
+                          m_routingTables);
 
-  m_routingHelper = CreateObject<RoutingHelper> ();
-  m_log = 1;
+  SystemWallClockMs clock;
+  clock.Start ();
+  if (m_traceBinding == 0)
+    {
+      std::ostringstream oss;
+      oss.str ("");
+      oss << "/NodeList/*/ApplicationList/*/$ns3::OnOffApplication/Tx";
+      Config::Connect (oss.str (), MakeCallback (&RoutingHelper::OnOffTrace, m_routingHelper));
+    }
+  else
+    {
+      TraceBinder::ConnectApplications (m_routingHelper->GetApplications (),
+                                        "ns3::OnOffApplication", "Tx",
+                                        MakeCallback (&RoutingHelper::OnOffTrace, m_routingHelper));
+    }
+  NS_LOG_UNCOND ("OnOff Tx binding (" << (m_traceBinding == 0 ? "config" : "direct")
+                 << "): " << clock.End () << " ms");
 }
-Experiment::~Experiment ()
-{
+
+void Experiment::ConfigureTracing(){
+
 }
-void Experiment::ParseCommandLineArguments(int argc, char** argv){
 
-  CommandLine cmd;
+void Experiment::RunSimulation(){
+  NS_LOG_INFO ("Run Simulation.");
 
-  cmd.AddValue ("totaltime", "Simulation end time", m_TotalSimTime);
-  cmd.AddValue ("nodes", "Number of nodes (i.e. vehicles)", m_nNodes);
-  cmd.AddValue ("sinks", "Number of routing sinks", m_nSinks);
-  cmd.AddValue ("traceMobility", "Enable mobility tracing", m_traceMobility);
-  cmd.AddValue ("protocol", "1=OLSR;2=AODV;3=DSDV;4=DSR", m_protocol);
-  cmd.AddValue ("lossModel", "1=Friis;2=ItuR1411Los;3=TwoRayGround;4=LogDistance", m_lossModel);
-  cmd.AddValue ("fading", "0=None;1=Nakagami;(buildings=1 overrides)", m_fading);
-  cmd.AddValue ("logFile", "Log file", m_logFile);
-  cmd.AddValue ("mobility", "1=RandomWalk2d;2=RandomWayPoint", m_mobility);
-  cmd.AddValue ("rate", "Rate", m_rate);
-  cmd.AddValue ("speed", "Node speed (m/s)", m_nodeSpeed);
-  cmd.AddValue ("pause", "Node pause (s)", m_nodePause);
-  cmd.AddValue ("verbose", "0=quiet;1=verbose", m_verbose);
-  cmd.AddValue ("macMode", "0=CSMA, 1=TDMA", m_macMode);
-  cmd.AddValue("baseHeight","Antenna Height for base station in meters",m_baseAntennaHeight);
-  cmd.AddValue("nodeHeight","Antenna Height for Node in meters",m_nodeAntennaHeight);
-  cmd.AddValue("baseGain","Antenna Gain for base station",m_baseAntennaGain);
-  cmd.AddValue("nodeGain","Antenna Gain for ABE",m_nodeAntennaGain);
-  cmd.AddValue("Frequency","Operating frequency in hz",m_freq);
+  m_throughputOs.open (m_CSVfileName2.c_str ());
+  m_throughputOs << "SimulationSecond,"
+                 << "ReceiveRate,"
+                 << "PacketsReceived,"
+                 << "OfferedLoad,"
+                 << "PacketsSent,"
+                 << "PacketDeliveryRatio"
+                 << std::endl;
+  Simulator::Schedule (Seconds (m_throughputInterval), &Experiment::CheckThroughput, this);
+
+  if (m_warmup > 0 && m_warmup < m_TotalSimTime && !m_warmupVariants.empty ())
+    {
+      Simulator::Schedule (Seconds (m_warmup), &Experiment::ForkVariants, this);
+    }
+
+  AnimationInterface *anim = SetupAnimation ();
+
+  
+  Simulator::Stop (Seconds (m_TotalSimTime));
+  if (m_allocStats > 0)
+    {
+      AllocationStats::Start (m_allocStats > 1);
+    }
+  double runStart = WallClockMs ();
+  Simulator::Run ();
+  m_runWallMs = WallClockMs () - runStart;
+  if (m_allocStats > 0)
+    {
+      AllocationStats::Stop ();
+      AllocationStats::Print (std::cout);
+      uint64_t txPkts = m_routingHelper->GetRoutingStats ().GetCumulativeTxPkts ();
+      if (txPkts > 0)
+        {
+          std::cout << "Allocations per Tx packet: " << double (AllocationStats::GetNAllocations ()) / txPkts << "\n";
+        }
+      std::cout << "Run wall time: " << m_runWallMs << " ms\n";
+    }
+
+  if (!m_eventProfile.empty ())
+    {
+      if (ProfilingScheduler::WriteReport (m_eventProfile))
+        {
+          std::cout << "Event profile: " << m_eventProfile << "\n";
+        }
+    }
+
+  // closes the last chunk before it is compressed
+  delete anim;
+  if (m_animMode == 2)
+    {
+      m_animCompressor.Finish ();
+      std::cout << "NetAnim chunks: " << m_animCompressor.GetNChunks () << "\n";
+    }
+
+  if (m_traceMobility)
+    {
+      m_mobilityTrace.Close ();
+      std::cout << "Mobility records: " << m_mobilityTrace.GetNRecords ()
+                << " (writer stalls: " << m_mobilityTrace.GetNStalls () << ")\n";
+    }
+  
+  if (m_rangeCulledLoss != 0)
+    {
+      std::cout << "Links evaluated: " << m_rangeCulledLoss->GetNEvaluated ()
+                << " culled: " << m_rangeCulledLoss->GetNCulled () << "\n";
+    }
+  if (m_cachedLoss != 0)
+    {
+      std::cout << "Loss cache hits: " << m_cachedLoss->GetNHits ()
+                << " misses: " << m_cachedLoss->GetNMisses ()
+                << " entries: " << m_cachedLoss->GetNEntries () << "\n";
+    }
+  m_throughputOs.close ();
+  std::cout<<"Tx Bytes: "<<m_routingHelper->GetRoutingStats().GetCumulativeTxBytes()<<"\n";
+  std::cout<<"Rx Bytes: "<<m_routingHelper->GetRoutingStats().GetCumulativeRxBytes()<<"\n";
   
+  Simulator::Destroy ();
+}
+
+void Experiment::ProcessOutputs(){
+
+    //Per-interval throughput, offered load and PDR: see CheckThroughput
+    //For STDMA parameters such as SelectionInterval, Minimum Candidate size etc. see --tuneStdma
+
+  if (m_warmupParent)
+    {
+      // merged from the variants by ForkVariants
+      return;
+    }
 
+  // one summary row per run; ExperimentSweep merges these across runs
+  WriteCsvHeader ();
+  std::ofstream out (m_CSVfileName.c_str (), std::ios::app);
+  RoutingStats & stats = m_routingHelper->GetRoutingStats ();
+  out << m_protocol << ","
+      << m_lossModel << ","
+      << m_mobility << ","
+      << m_nNodes << ","
+      << m_nSinks << ","
+      << m_nodeSpeed << ","
+      << m_nodePause << ","
+      << m_macMode << ","
+      << m_rate << ","
+      << m_packetSize << ","
+      << m_TotalSimTime << ","
+      << stats.GetCumulativeTxBytes () << ","
+      << stats.GetCumulativeRxBytes () << ","
+      << stats.GetCumulativeRxPkts () << ","
+      << (stats.GetCumulativeRxBytes () * 8.0) / 1000 / (m_TotalSimTime - m_measureStart) << ","
+      << stats.GetMeanDelay ().GetSeconds () * 1000 << ","
+      << m_phyFidelity << ","
+      << m_runWallMs
+      << std::endl;
+  out.close ();
+
+  if (!m_statsFile.empty ())
+    {
+      RoutingStatsHistory & history = m_routingHelper->GetRoutingStatsHistory ();
+      bool binary = m_statsFile.size () > 4 && m_statsFile.compare (m_statsFile.size () - 4, 4, ".bin") == 0;
+      if (!(binary ? history.WriteBinary (m_statsFile) : history.WriteCsv (m_statsFile)))
+        {
+          NS_LOG_ERROR ("Unable to write " << m_statsFile);
+        }
+    }
 }
 
-void Experiment::ConfigureNodes(){
-  m_TxNodes.Create(m_nNodes);
-  m_baseNodes.Create(m_nBase);
-  for(uint32_t i=0;i<m_nBase;i++){
-    m_allNodes.Add(m_baseNodes.Get(i));
-  }
-  for(uint32_t i=0;i<m_nNodes;i++){
-    m_allNodes.Add(m_TxNodes.Get(i));
-  }
+void
+Experiment::WriteCsvHeader ()
+{
+  std::ofstream out (m_CSVfileName.c_str ());
+  out << "Protocol,"
+      << "LossModel,"
+      << "Mobility,"
+      << "Nodes,"
+      << "Sinks,"
+      << "Speed,"
+      << "Pause,"
+      << "MacMode,"
+      << "Rate,"
+      << "PacketSize,"
+      << "TotalTime,"
+      << "TxBytes,"
+      << "RxBytes,"
+      << "RxPkts,"
+      << "ThroughputKbps,"
+      << "MeanDelayMs,"
+      << "PhyFidelity,"
+      << "RunWallMs"
+      << std::endl;
+  out.close ();
 }
 
-void Experiment::ConfigureChannels(){
+void Experiment::CourseChange (MobilityTraceLogger *logger, std::string foo, Ptr<const MobilityModel> mobility)
+{
+  logger->Record (mobility);
+}
 
-  if (m_lossModel == 1)
+void Experiment::CheckThroughput(){
+  // constant work per interval, independent of the packet count
+  RoutingStats & stats = m_routingHelper->GetRoutingStats ();
+  uint64_t rxBytes = stats.GetRxBytes ();
+  uint64_t rxPkts = stats.GetRxPkts ();
+  uint64_t txBytes = stats.GetTxBytes ();
+  uint64_t txPkts = stats.GetTxPkts ();
+  stats.SetRxBytes (0);
+  stats.SetRxPkts (0);
+  stats.SetTxBytes (0);
+  stats.SetTxPkts (0);
+
+  double kbps = (rxBytes * 8.0) / 1000 / m_throughputInterval;
+  double offeredKbps = (txBytes * 8.0) / 1000 / m_throughputInterval;
+  double pdr = txPkts > 0 ? (100.0 * rxPkts) / txPkts : 0;
+
+  m_throughputOs << Simulator::Now ().GetSeconds () << ","
+                 << kbps << ","
+                 << rxPkts << ","
+                 << offeredKbps << ","
+                 << txPkts << ","
+                 << pdr
+                 << "\n";
+
+  Simulator::Schedule (Seconds (m_throughputInterval), &Experiment::CheckThroughput, this);
+}
+
+void
+Experiment::ForkVariants ()
+{
+  // cartesian product of the variant grid
+  std::vector<std::vector<std::pair<std::string, std::string> > > variants (1);
+  std::istringstream dimensions (m_warmupVariants);
+  std::string dimension;
+  while (std::getline (dimensions, dimension, ';'))
     {
-      m_lossModelName = "ns3::FriisPropagationLossModel";
+      std::string::size_type eq = dimension.find ('=');
+      if (dimension.empty () || eq == std::string::npos)
+        {
+          NS_LOG_ERROR ("Ignoring malformed warm-up variant \"" << dimension << "\"");
+          continue;
+        }
+      std::istringstream values (dimension.substr (eq + 1));
+      std::string value;
+      std::vector<std::vector<std::pair<std::string, std::string> > > expanded;
+      while (std::getline (values, value, ','))
+        {
+          for (uint32_t i = 0; i < variants.size (); i++)
+            {
+              expanded.push_back (variants[i]);
+              expanded.back ().push_back (std::make_pair (dimension.substr (0, eq), value));
+            }
+        }
+      variants = expanded;
     }
-  else if (m_lossModel == 2)
+
+  uint32_t jobs = m_warmupJobs;
+  if (jobs == 0)
     {
-      m_lossModelName = "ns3::ItuR1411LosPropagationLossModel";
+      long cores = sysconf (_SC_NPROCESSORS_ONLN);
+      jobs = cores > 0 ? cores : 1;
     }
-  else if (m_lossModel == 3)
+
+  std::cout << "Forking " << variants.size () << " variants at "
+            << Simulator::Now ().GetSeconds () << " s\n";
+  // the children must not flush our buffered output a second time
+  std::cout.flush ();
+  std::cerr.flush ();
+  m_throughputOs.flush ();
+
+  std::vector<bool> succeeded (variants.size (), false);
+  std::map<pid_t, uint32_t> running;
+  uint32_t next = 0;
+  while (next < variants.size () || !running.empty ())
     {
-      m_lossModelName = "ns3::TwoRayGroundPropagationLossModel";
+      while (running.size () < jobs && next < variants.size ())
+        {
+          pid_t pid = fork ();
+          if (pid == 0)
+            {
+              // the child continues the run from here
+              ApplyVariant (next, variants[next]);
+              return;
+            }
+          if (pid < 0)
+            {
+              NS_LOG_ERROR ("Unable to fork variant " << next);
+              if (running.empty ())
+                {
+                  break;
+                }
+              jobs = running.size ();
+              continue;
+            }
+          running[pid] = next++;
+        }
+      if (running.empty ())
+        {
+          break;
+        }
+
+      int status;
+      pid_t pid = waitpid (-1, &status, 0);
+      if (pid < 0)
+        {
+          break;
+        }
+      std::map<pid_t, uint32_t>::iterator it = running.find (pid);
+      if (it == running.end ())
+        {
+          continue;
+        }
+      succeeded[it->second] = WIFEXITED (status) && WEXITSTATUS (status) == 0;
+      std::cout << "Variant " << it->second + 1 << "/" << variants.size ()
+                << (succeeded[it->second] ? " done\n" : " FAILED\n");
+      running.erase (it);
     }
-  else if (m_lossModel == 4)
+
+  std::vector<std::string> parts;
+  for (uint32_t i = 0; i < variants.size (); i++)
     {
-      m_lossModelName = "ns3::LogDistancePropagationLossModel";
+      std::ostringstream part;
+      part << m_CSVfileName << ".variant" << i;
+      parts.push_back (part.str ());
     }
-  else
+  if (!MergeCsvParts (m_CSVfileName, parts, succeeded))
     {
-      // Unsupported propagation loss model.
-      // Treating as ERROR
-      NS_LOG_ERROR ("Invalid propagation loss model specified.  Values must be [1-4], where 1=Friis;2=ItuR1411Los;3=TwoRayGround;4=LogDistance");
+      NS_LOG_ERROR ("Some warm-up variants failed");
     }
-  
-  
-  
-  //BaseStationChannel
-  YansWifiChannelHelper WifiChannel;
-  WifiChannel.SetPropagationDelay ("ns3::ConstantSpeedPropagationDelayModel");
+  m_warmupParent = true;
+  Simulator::Stop ();
+}
 
-  if (m_lossModel == 3)
+void
+Experiment::ApplyVariant (uint32_t variant, const std::vector<std::pair<std::string, std::string> > & settings)
+{
+  std::ostringstream suffix;
+  suffix << ".variant" << variant;
+
+  // per-variant console output, next to the summary part
+  if (freopen ((m_CSVfileName + suffix.str () + ".log").c_str (), "w", stdout) == NULL)
     {
-      // two-ray requires antenna height (else defaults to Friss)
-      WifiChannel.AddPropagationLoss (m_lossModelName, "Frequency", DoubleValue (m_freq), "HeightAboveZ", DoubleValue (m_baseAntennaHeight));
+      std::exit (1);
     }
-  else
+
+  for (uint32_t i = 0; i < settings.size (); i++)
     {
-      WifiChannel.AddPropagationLoss (m_lossModelName, "Frequency", DoubleValue (m_freq));
+      if (settings[i].first == "rate")
+        {
+          m_rate = settings[i].second;
+          Config::Set ("/NodeList/*/ApplicationList/*/$ns3::OnOffApplication/DataRate",
+                       StringValue (m_rate));
+        }
+      else if (settings[i].first == "packetSize")
+        {
+          m_packetSize = std::atoi (settings[i].second.c_str ());
+          Config::Set ("/NodeList/*/ApplicationList/*/$ns3::OnOffApplication/PacketSize",
+                       UintegerValue (m_packetSize));
+        }
+      else
+        {
+          NS_LOG_ERROR ("Unknown warm-up variant parameter " << settings[i].first);
+        }
     }
 
+  // measure from the warm-up time only
+  m_routingHelper->GetRoutingStats () = RoutingStats ();
+  m_measureStart = Simulator::Now ().GetSeconds ();
+
+  m_CSVfileName += suffix.str ();
+  m_throughputOs.close ();
+  m_CSVfileName2 += suffix.str ();
+  m_throughputOs.open (m_CSVfileName2.c_str ());
+  m_throughputOs << "SimulationSecond,"
+                 << "ReceiveRate,"
+                 << "PacketsReceived,"
+                 << "OfferedLoad,"
+                 << "PacketsSent,"
+                 << "PacketDeliveryRatio"
+                 << std::endl;
+  if (!m_statsFile.empty ())
+    {
+      m_statsFile += suffix.str ();
+    }
+  if (!m_eventProfile.empty ())
+    {
+      m_eventProfile += suffix.str ();
+    }
+  if (!GetPhaseReportFile ().empty ())
+    {
+      SetPhaseReportFile (GetPhaseReportFile () + suffix.str ());
+    }
+}
 
-  Ptr<YansWifiChannel> Channel = WifiChannel.Create ();
-  
+void
+Experiment::SetOutputSuffix (std::string suffix)
+{
+  m_outputSuffix = suffix;
+}
 
-  YansWifiPhyHelper basePhy = YansWifiPhyHelper::Default();
-  basePhy.SetChannel(Channel);
-  
-  YansWifiPhyHelper nodePhy = YansWifiPhyHelper::Default();
-  nodePhy.SetChannel(Channel);
+void Experiment::SetupLogFile(){
+  m_os.open (m_logFile.c_str ());
+}
 
-  basePhy.SetPcapDataLinkType (YansWifiPhyHelper::DLT_IEEE802_11); //Tracing Stuff
-  nodePhy.SetPcapDataLinkType (YansWifiPhyHelper::DLT_IEEE802_11);
+void Experiment::SetDefaultAttributeValues(){
 
-  WifiHelper wifi;
-  if(m_verbose){
-    wifi.EnableLogComponents();
-  }
+  Config::SetDefault ("ns3::OnOffApplication::PacketSize",UintegerValue (m_packetSize));
+  Config::SetDefault ("ns3::OnOffApplication::DataRate",  StringValue (m_rate));
 
+}
 
-  basePhy.Set("TxGain",DoubleValue(m_baseAntennaGain));
-  nodePhy.Set("TxGain",DoubleValue(m_nodeAntennaGain));
+void Experiment::ConfigureDevices(){
+ //Already done in ConfigureChannels
+}
 
-  wifi.SetRemoteStationManager ("ns3::ConstantRateWifiManager");
 
 
-  //Configuring the mac_layer
-  if(m_macMode == 0){
-    NqosWifiMacHelper wifiMac = NqosWifiMacHelper::Default ();
-    Ssid ssid = Ssid("base-station");
-    wifiMac.SetType ("ns3::StaWifiMac",
-                "Ssid", SsidValue (ssid),
-                "ActiveProbing", BooleanValue (false));
+/**
+ * \brief Runs a grid of Experiment configurations, one forked
+ * process per configuration, and merges their CSV summary rows
+ *
+ * Every point of the grid is run by a fresh process because the
+ * Simulator is a singleton; at most the configured number of jobs
+ * are alive at any time.
+ */
+class ExperimentSweep
+{
+public:
+  /**
+   * \brief Constructor; one job per online core by default
+   * \return none
+   */
+  ExperimentSweep ();
 
-    m_TxDevices = wifi.Install(nodePhy,wifiMac,m_TxNodes);
+  /**
+   * \brief Sets the maximum number of concurrently running workers
+   * \param jobs number of workers (0 keeps the default)
+   * \return none
+   */
+  void SetJobs (uint32_t jobs);
 
-    wifiMac.SetType("ns3::ApWifiMac","Ssid",SsidValue(ssid));
+  /**
+   * \brief Sets the arguments passed unchanged to every run
+   * \param program the program name (argv[0])
+   * \param args command line arguments, without the sweep options
+   * \return none
+   */
+  void SetBaseArguments (std::string program, std::vector<std::string> args);
 
-    m_baseDevices = wifi.Install(basePhy,wifiMac,m_baseNodes);
+  /**
+   * \brief Adds the cartesian product of a parameter grid
+   * \param grid grid of Experiment::ParseCommandLineArguments
+   * parameters, e.g. "protocol=1,2;lossModel=1,3;nodes=10,50"
+   * \return none
+   */
+  void AddGrid (std::string grid);
 
-  }
-  else if(m_macMode == 1){
-    //TBD STDMA / TDMA
+  /**
+   * \brief Adds a single point
+   * \param args the Experiment arguments of the point
+   * \return none
+   */
+  void AddPoint (std::vector<std::string> args);
+
+  /**
+   * \brief Returns whether a point of the last Run completed; the
+   * merged CSV holds one row per completed point, in point order
+   * \param point index of the point
+   * \return true if the point completed successfully
+   */
+  bool Succeeded (uint32_t point) const;
+
+  /**
+   * \brief Returns the number of points to be run
+   * \return the number of points
+   */
+  uint32_t GetNPoints () const;
+
+  /**
+   * \brief Runs every point and merges the results
+   * \param csvFileName the merged CSV output file
+   * \return true if every point completed successfully
+   */
+  bool Run (std::string csvFileName);
+
+private:
+  /**
+   * \brief Forks a worker for a point of the grid
+   * \param point index of the point
+   * \param partFileName CSV output file of the worker
+   * \return the process id of the worker, or -1 on failure
+   */
+  pid_t Spawn (uint32_t point, std::string partFileName);
+
+  std::string m_program;
+  std::vector<std::string> m_baseArgs;
+  std::vector<std::vector<std::string> > m_points;
+  std::vector<bool> m_succeeded;
+  uint32_t m_jobs;
+};
+
+ExperimentSweep::ExperimentSweep ()
+  : m_program ("station-ap-demo"),
+    m_jobs (1)
+{
+  long cores = sysconf (_SC_NPROCESSORS_ONLN);
+  if (cores > 0)
+    {
+      m_jobs = cores;
+    }
+}
+
+void
+ExperimentSweep::SetJobs (uint32_t jobs)
+{
+  if (jobs > 0)
+    {
+      m_jobs = jobs;
+    }
+}
+
+void
+ExperimentSweep::SetBaseArguments (std::string program, std::vector<std::string> args)
+{
+  m_program = program;
+  m_baseArgs = args;
+}
+
+void
+ExperimentSweep::AddGrid (std::string grid)
+{
+  std::vector<std::vector<std::string> > points (1);
+  std::istringstream dimensions (grid);
+  std::string dimension;
+  while (std::getline (dimensions, dimension, ';'))
+    {
+      std::string::size_type eq = dimension.find ('=');
+      if (dimension.empty () || eq == std::string::npos)
+        {
+          NS_LOG_ERROR ("Ignoring malformed sweep dimension \"" << dimension << "\"");
+          continue;
+        }
+      std::string name = dimension.substr (0, eq);
+      std::istringstream values (dimension.substr (eq + 1));
+      std::string value;
+      std::vector<std::vector<std::string> > expanded;
+      while (std::getline (values, value, ','))
+        {
+          for (uint32_t i = 0; i < points.size (); i++)
+            {
+              std::vector<std::string> point = points[i];
+              point.push_back ("--" + name + "=" + value);
+              expanded.push_back (point);
+            }
+        }
+      points = expanded;
+    }
+  m_points.insert (m_points.end (), points.begin (), points.end ());
+}
+
+void
+ExperimentSweep::AddPoint (std::vector<std::string> args)
+{
+  m_points.push_back (args);
+}
+
+bool
+ExperimentSweep::Succeeded (uint32_t point) const
+{
+  return point < m_succeeded.size () && m_succeeded[point];
+}
+
+uint32_t
+ExperimentSweep::GetNPoints () const
+{
+  return m_points.size ();
+}
 
+pid_t
+ExperimentSweep::Spawn (uint32_t point, std::string partFileName)
+{
+  // don't let the worker flush our buffered output a second time
+  std::cout.flush ();
+  std::cerr.flush ();
+  pid_t pid = fork ();
+  if (pid != 0)
+    {
+      return pid;
+    }
 
-  }
-  
- if (m_asciiTrace != 0)
+  std::vector<std::string> args;
+  args.push_back (m_program);
+  args.insert (args.end (), m_baseArgs.begin (), m_baseArgs.end ());
+  args.insert (args.end (), m_points[point].begin (), m_points[point].end ());
+  args.push_back ("--CSVfileName=" + partFileName);
+  // one NetAnim XML per worker would dominate the run times; only
+  // written when asked for
+  bool anim = false;
+  for (uint32_t i = 0; i < args.size (); i++)
     {
-      AsciiTraceHelper ascii;
-      Ptr<OutputStreamWrapper> osw = ascii.CreateFileStream ( (m_trName +  "-base.tr").c_str ());
-      Ptr<OutputStreamWrapper> osw1 = ascii.CreateFileStream ( (m_trName +  "-sta.tr").c_str ());
-      basePhy.EnableAsciiAll (osw);
-      nodePhy.EnableAsciiAll (osw1);
+      anim = anim || args[i].compare (0, 11, "--animMode=") == 0
+        || args[i].compare (0, 11, "--animFile=") == 0;
     }
-  if (m_pcap != 0)
+  if (!anim)
     {
-      basePhy.EnablePcapAll ("base-station-pcap");
-      nodePhy.EnablePcapAll ("node-pcap");
+      args.push_back ("--animMode=0");
     }
 
-  for(uint32_t i=0;i<m_nBase;i++){
-    m_allDevices.Add(m_baseDevices.Get(i));
-  }
-  for(uint32_t i=0;i<m_nNodes;i++){
-    m_allDevices.Add(m_TxDevices.Get(i));
-  }
+  std::vector<char *> argv;
+  for (uint32_t i = 0; i < args.size (); i++)
+    {
+      argv.push_back (const_cast<char *> (args[i].c_str ()));
+    }
+  argv.push_back (NULL);
 
+  // per-run console output would interleave; keep it next to the part
+  if (freopen ((partFileName + ".log").c_str (), "w", stdout) == NULL)
+    {
+      std::exit (1);
+    }
+  {
+    std::ostringstream suffix;
+    suffix << ".part" << point;
+    Experiment experiment;
+    experiment.SetOutputSuffix (suffix.str ());
+    experiment.Simulate (args.size (), &argv[0]);
+  }
+  std::cout.flush ();
+  std::exit (0);
 }
 
-void Experiment::ConfigureMobility(){
-
+bool
+ExperimentSweep::Run (std::string csvFileName)
+{
+  uint32_t nPoints = m_points.size ();
+  std::vector<bool> succeeded (nPoints, false);
+  std::map<pid_t, uint32_t> running;
+  uint32_t next = 0;
+
+  std::cout << "Sweeping " << nPoints << " configurations with "
+            << m_jobs << " workers\n";
+  while (next < nPoints || !running.empty ())
+    {
+      while (running.size () < m_jobs && next < nPoints)
+        {
+          std::ostringstream part;
+          part << csvFileName << ".part" << next;
+          pid_t pid = Spawn (next, part.str ());
+          if (pid < 0)
+            {
+              NS_LOG_ERROR ("Unable to fork a worker for point " << next);
+              if (running.empty ())
+                {
+                  return false;
+                }
+              break;
+            }
+          running[pid] = next++;
+        }
 
-  //Stationary base stations
-  MobilityHelper mobility;
+      int status;
+      pid_t pid = waitpid (-1, &status, 0);
+      if (pid < 0)
+        {
+          break;
+        }
+      std::map<pid_t, uint32_t>::iterator it = running.find (pid);
+      if (it == running.end ())
+        {
+          continue;
+        }
+      uint32_t point = it->second;
+      running.erase (it);
+      succeeded[point] = WIFEXITED (status) && WEXITSTATUS (status) == 0;
+      std::cout << "Configuration " << point + 1 << "/" << nPoints
+                << (succeeded[point] ? " done\n" : " FAILED\n");
+    }
 
-  mobility.SetMobilityModel ("ns3::ConstantPositionMobilityModel");
-  mobility.SetPositionAllocator ("ns3::GridPositionAllocator",
-                                    "MinX", DoubleValue (50.0),
-                                    "MinY", DoubleValue (0.0),
-                                    "DeltaX", DoubleValue (5.0),
-                                    "DeltaY", DoubleValue (0.0),
-                                    "GridWidth", UintegerValue (10),
-                                    "LayoutType", StringValue ("RowFirst"));
-  mobility.Install (m_baseNodes);
+  std::vector<std::string> parts;
+  for (uint32_t point = 0; point < nPoints; point++)
+    {
+      std::ostringstream part;
+      part << csvFileName << ".part" << point;
+      parts.push_back (part.str ());
+    }
+  // merge in grid order
+  m_succeeded = succeeded;
+  return MergeCsvParts (csvFileName, parts, succeeded);
+}
 
-  m_streamIndex += mobility.AssignStreams (m_baseNodes, m_streamIndex);
+/**
+ * \brief Removes --name=value from the arguments
+ * \param args the command line arguments
+ * \param name the argument name
+ * \param value receives the argument value, if present
+ * \return true if the argument was present
+ */
+static bool
+ExtractArgument (std::vector<std::string> & args, std::string name, std::string & value)
+{
+  std::string prefix = "--" + name + "=";
+  for (std::vector<std::string>::iterator it = args.begin (); it != args.end (); ++it)
+    {
+      if (it->compare (0, prefix.size (), prefix) == 0)
+        {
+          value = it->substr (prefix.size ());
+          args.erase (it);
+          return true;
+        }
+    }
+  return false;
+}
 
+/**
+ * \brief Reads columns of every row of a sweep output
+ * \param csvFileName the merged sweep output
+ * \param names the columns to read
+ * \param rows receives the named columns of each row, in order; a
+ * column missing from the header aborts
+ * \return none
+ */
+static void
+ReadSweepColumns (std::string csvFileName, const std::vector<std::string> & names,
+                  std::vector<std::vector<double> > & rows)
+{
+  std::ifstream in (csvFileName.c_str ());
+  std::string line;
+  if (!std::getline (in, line))
+    {
+      return;
+    }
+  // column positions from the header written by Experiment::WriteCsvHeader
+  std::map<std::string, uint32_t> columns;
+  std::istringstream header (line);
+  std::string name;
+  for (uint32_t i = 0; std::getline (header, name, ','); i++)
+    {
+      columns[name] = i;
+    }
+  std::vector<uint32_t> positions;
+  for (uint32_t i = 0; i < names.size (); i++)
+    {
+      std::map<std::string, uint32_t>::const_iterator column = columns.find (names[i]);
+      NS_ABORT_MSG_IF (column == columns.end (), "No column " << names[i] << " in " << csvFileName);
+      positions.push_back (column->second);
+    }
+  while (std::getline (in, line))
+    {
+      std::vector<std::string> fields;
+      std::istringstream row (line);
+      std::string field;
+      while (std::getline (row, field, ','))
+        {
+          fields.push_back (field);
+        }
+      if (fields.size () < columns.size ())
+        {
+          continue;
+        }
+      std::vector<double> values;
+      for (uint32_t i = 0; i < names.size (); i++)
+        {
+          values.push_back (std::atof (fields[positions[i]].c_str ()));
+        }
+      rows.push_back (values);
+    }
+}
 
-  std::stringstream ssSpeed;
-  ssSpeed << "ns3::UniformRandomVariable[Min=0.0|Max=" << m_nodeSpeed << "]";
-  std::stringstream ssPause;
-  ssPause << "ns3::ConstantRandomVariable[Constant=" << m_nodePause << "]";
+/**
+ * \brief Prints CSMA and STDMA results of a --macBenchmark sweep side by side
+ * \param csvFileName the merged sweep output
+ * \return none
+ */
+static void
+PrintMacBenchmark (std::string csvFileName)
+{
+  std::vector<std::string> names;
+  names.push_back ("Nodes");
+  names.push_back ("MacMode");
+  names.push_back ("ThroughputKbps");
+  names.push_back ("MeanDelayMs");
+  std::vector<std::vector<double> > rows;
+  ReadSweepColumns (csvFileName, names, rows);
+
+  // nodes -> macMode -> (throughput, delay)
+  std::map<uint32_t, std::map<uint32_t, std::pair<double, double> > > results;
+  for (uint32_t i = 0; i < rows.size (); i++)
+    {
+      results[rows[i][0]][rows[i][1]] = std::make_pair (rows[i][2], rows[i][3]);
+    }
 
-  if(m_mobility == 1){
-    //Random Walk
-    ObjectFactory pos2;
-    pos2.SetTypeId ("ns3::RandomBoxPositionAllocator");
-    pos2.Set ("X", StringValue ("ns3::UniformRandomVariable[Min=0.0|Max=1500.0]"));
-    pos2.Set ("Y", StringValue ("ns3::UniformRandomVariable[Min=10.0|Max=300]"));
-    Ptr<PositionAllocator> nodePositionAlloc = pos2.Create ()->GetObject<PositionAllocator> ();
-    m_streamIndex += nodePositionAlloc->AssignStreams (m_streamIndex);
+  std::cout << "Nodes\tCSMA kbps\tCSMA delay ms\tSTDMA kbps\tSTDMA delay ms\n";
+  for (std::map<uint32_t, std::map<uint32_t, std::pair<double, double> > >::iterator i = results.begin ();
+       i != results.end (); ++i)
+    {
+      std::cout << i->first
+                << "\t" << i->second[0].first << "\t" << i->second[0].second
+                << "\t" << i->second[1].first << "\t" << i->second[1].second << "\n";
+    }
+}
 
-    mobility.SetMobilityModel ("ns3::RandomWalk2dMobilityModel",
-                            "Bounds", RectangleValue (Rectangle (0, 1500, 10, 1500)),
-                            "PositionAllocator",PointerValue(nodePositionAlloc),
-                            "Speed",StringValue(ssSpeed.str()),
-                            "Distance",DoubleValue(10.0));
+/**
+ * \brief Compares the runs of a --phyValidation sweep with the full
+ * error rate model against the same runs with PER tables
+ * \param csvFileName the merged sweep output
+ * \param sweep the sweep, whose points alternate phyFidelity=0,1
+ * \return none
+ */
+static void
+PrintPhyValidation (std::string csvFileName, const ExperimentSweep & sweep)
+{
+  std::vector<std::string> names;
+  names.push_back ("Nodes");
+  names.push_back ("ThroughputKbps");
+  names.push_back ("TxBytes");
+  names.push_back ("RxBytes");
+  names.push_back ("RunWallMs");
+  std::vector<std::vector<double> > rows;
+  ReadSweepColumns (csvFileName, names, rows);
+
+  std::cout << "Point\tNodes\tFull kbps\tTable kbps\tDelta %\tFull PDR\tTable PDR\tDelta\tSpeedup\n";
+  double fullWallMs = 0;
+  double tableWallMs = 0;
+  double sumThroughputDelta = 0;
+  double sumPdrDelta = 0;
+  uint32_t nPairs = 0;
+  for (uint32_t point = 0, row = 0; point + 1 < sweep.GetNPoints (); point += 2)
+    {
+      bool full = sweep.Succeeded (point);
+      bool table = sweep.Succeeded (point + 1);
+      if (!full || !table || row + 1 >= rows.size ())
+        {
+          row += full + table;
+          continue;
+        }
+      const std::vector<double> & f = rows[row];
+      const std::vector<double> & t = rows[row + 1];
+      row += 2;
+      double fullPdr = f[2] > 0 ? f[3] / f[2] : 0;
+      double tablePdr = t[2] > 0 ? t[3] / t[2] : 0;
+      double throughputDelta = f[1] > 0 ? 100.0 * (t[1] - f[1]) / f[1] : 0;
+      std::cout << point / 2 << "\t" << f[0] << "\t" << f[1] << "\t" << t[1] << "\t" << throughputDelta
+                << "\t" << fullPdr << "\t" << tablePdr << "\t" << tablePdr - fullPdr
+                << "\t" << (t[4] > 0 ? f[4] / t[4] : 0) << "\n";
+      fullWallMs += f[4];
+      tableWallMs += t[4];
+      sumThroughputDelta += std::fabs (throughputDelta);
+      sumPdrDelta += std::fabs (tablePdr - fullPdr);
+      nPairs++;
+    }
+  if (nPairs > 0 && tableWallMs > 0)
+    {
+      std::cout << "Mean |throughput delta| " << sumThroughputDelta / nPairs << " %, mean |PDR delta| "
+                << sumPdrDelta / nPairs << ", Run speedup " << fullWallMs / tableWallMs << "\n";
+    }
+}
 
-    mobility.SetPositionAllocator (nodePositionAlloc);
+/**
+ * \brief Searches the stdma::StdmaMac attributes by successive halving
+ *
+ * Random configurations are first run for a short simulated time; after
+ * every rung the configurations on the Pareto front of throughput
+ * against delay, and at least the best 1/eta of the others, are run
+ * again for eta times longer, until the longest budget is reached.
+ * Every rung is an ExperimentSweep, so runs use all the workers.
+ */
+class StdmaTuner
+{
+public:
+  /**
+   * \brief Constructor
+   * \return none
+   */
+  StdmaTuner ();
 
-    mobility.Install(m_TxNodes);
+  /**
+   * \brief Sets the simulated time of the first and the last rung
+   * \param minBudget simulated time (s) of the first rung
+   * \param maxBudget simulated time (s) of the last rung
+   * \param eta budget growth and reduction factor per rung
+   * \return none
+   */
+  void SetBudget (double minBudget, double maxBudget, uint32_t eta);
 
-    m_streamIndex += mobility.AssignStreams (m_TxNodes, m_streamIndex);
+  /**
+   * \brief Runs the search and reports the final Pareto front
+   * \param nConfigurations number of random configurations of the first rung
+   * \param sweep sweep with the jobs and the base arguments set
+   * \param csvFileName receives every evaluation
+   * \return true if the last rung produced any result
+   */
+  bool Run (uint32_t nConfigurations, ExperimentSweep sweep, std::string csvFileName);
 
-  
-  }
-  else if(m_mobility == 2){
-    //Random Way Point
-    ObjectFactory pos2;
-    pos2.SetTypeId ("ns3::RandomBoxPositionAllocator");
-    pos2.Set ("X", StringValue ("ns3::UniformRandomVariable[Min=0.0|Max=300.0]"));
-    pos2.Set ("Y", StringValue ("ns3::UniformRandomVariable[Min=10.0|Max=300]"));
-    Ptr<PositionAllocator> nodePositionAlloc = pos2.Create ()->GetObject<PositionAllocator> ();
-    m_streamIndex += nodePositionAlloc->AssignStreams (m_streamIndex);
+private:
+  /// One point of the attribute space and its latest result
+  struct Configuration
+  {
+    double frameDuration;
+    uint32_t reportRate;
+    double selectionInterval;
+    uint32_t minCandidates;
+    uint32_t timeoutMin;
+    uint32_t timeoutMax;
+    double throughput; // kbps
+    double delay;      // ms
+    uint32_t dominatedBy;
+  };
 
-    mobility.SetMobilityModel ("ns3::RandomWaypointMobilityModel",
-                                      "Speed", StringValue (ssSpeed.str ()),
-                                      "Pause", StringValue (ssPause.str ()),
-                                      "PositionAllocator", PointerValue (nodePositionAlloc));
+  /**
+   * \brief Draws a random configuration
+   * \return the configuration
+   */
+  Configuration Sample ();
 
-    mobility.SetPositionAllocator (nodePositionAlloc);
+  /**
+   * \brief Returns the Experiment arguments of a configuration
+   * \param c the configuration
+   * \param budget the simulated time (s)
+   * \return the arguments
+   */
+  std::vector<std::string> Arguments (const Configuration & c, double budget) const;
 
-    mobility.Install(m_TxNodes);
+  /**
+   * \brief Counts, for every configuration, the configurations with
+   * at least its throughput and at most its delay, better in one
+   * \param configurations the evaluated configurations
+   * \return none
+   */
+  static void CountDominating (std::vector<Configuration> & configurations);
 
-    m_streamIndex += mobility.AssignStreams (m_TxNodes, m_streamIndex);
-  }
+  /**
+   * \brief Orders configurations by the number dominating them, then
+   * by throughput
+   * \param a a configuration
+   * \param b another configuration
+   * \return true if a goes first
+   */
+  static bool ParetoLess (const Configuration & a, const Configuration & b);
 
+  Ptr<UniformRandomVariable> m_random;
+  double m_minBudget;
+  double m_maxBudget;
+  uint32_t m_eta;
+};
 
-  Config::Connect ("/NodeList/*/$ns3::MobilityModel/CourseChange",
-                   MakeBoundCallback (&Experiment::CourseChange, &m_os));
+StdmaTuner::StdmaTuner ()
+  : m_minBudget (20),
+    m_maxBudget (300),
+    m_eta (3)
+{
+  m_random = CreateObject<UniformRandomVariable> ();
+  m_random->SetStream (1);
 }
 
-void Experiment::ConfigureApplications(){
-  m_routingHelper->Install (m_allNodes,
-                          m_allDevices,
-                          m_allInterfaces,
-                          m_TotalSimTime,
-                          m_protocol,
-                          m_nSinks,
-                          m_routingTables);
-
-  std::ostringstream oss;
-  oss.str ("");
-  oss << "/NodeList/*/ApplicationList/*/$ns3::OnOffApplication/Tx";
-  Config::Connect (oss.str (), MakeCallback (&RoutingHelper::OnOffTrace, m_routingHelper));
+void
+StdmaTuner::SetBudget (double minBudget, double maxBudget, uint32_t eta)
+{
+  m_minBudget = minBudget;
+  m_maxBudget = std::max (minBudget, maxBudget);
+  m_eta = std::max<uint32_t> (eta, 2);
 }
 
-void Experiment::ConfigureTracing(){
-
+StdmaTuner::Configuration
+StdmaTuner::Sample ()
+{
+  static const double frameDurations[] = { 0.5, 1.0, 2.0 };
+  static const uint32_t reportRates[] = { 5, 10, 20 };
+  Configuration c;
+  c.frameDuration = frameDurations[m_random->GetInteger (0, 2)];
+  c.reportRate = reportRates[m_random->GetInteger (0, 2)];
+  c.selectionInterval = m_random->GetValue (0.05, 0.5);
+  c.minCandidates = m_random->GetInteger (2, 8);
+  c.timeoutMin = m_random->GetInteger (3, 8);
+  c.timeoutMax = c.timeoutMin + m_random->GetInteger (0, 4);
+  c.throughput = 0;
+  c.delay = 0;
+  c.dominatedBy = 0;
+  return c;
 }
 
-void Experiment::RunSimulation(){
-  NS_LOG_INFO ("Run Simulation.");
-
-  CheckThroughput ();
-
-  AnimationInterface anim("experiment.xml");
-  anim.SetMaxPktsPerTraceFile(50000000);
-
-  
-  Simulator::Stop (Seconds (m_TotalSimTime));
-  Simulator::Run ();
-
-  
-  
-  std::cout<<"Tx Bytes: "<<m_routingHelper->GetRoutingStats().GetTxBytes()<<"\n";
-  std::cout<<"Rx Bytes: "<<m_routingHelper->GetRoutingStats().GetRxBytes()<<"\n";
-  
-  Simulator::Destroy ();
+std::vector<std::string>
+StdmaTuner::Arguments (const Configuration & c, double budget) const
+{
+  std::ostringstream args;
+  args << "--macMode=1"
+       << " --totaltime=" << budget
+       << " --stdmaFrameDuration=" << c.frameDuration
+       << " --stdmaReportRate=" << c.reportRate
+       << " --stdmaSelectionInterval=" << c.selectionInterval
+       << " --stdmaMinCandidates=" << c.minCandidates
+       << " --stdmaTimeoutMin=" << c.timeoutMin
+       << " --stdmaTimeoutMax=" << c.timeoutMax;
+  std::vector<std::string> result;
+  std::istringstream words (args.str ());
+  std::string word;
+  while (words >> word)
+    {
+      result.push_back (word);
+    }
+  return result;
 }
 
-void Experiment::ProcessOutputs(){
-
-//Measure Throughput w.r.t no of nodes,
-    //Measure packet loss
-    //Measure Packet delivery ratio
-    //For STDMA change paramters such as SelectionInterval, Minimum Candidate size etc..
-    
+void
+StdmaTuner::CountDominating (std::vector<Configuration> & configurations)
+{
+  for (uint32_t i = 0; i < configurations.size (); i++)
+    {
+      Configuration & a = configurations[i];
+      a.dominatedBy = 0;
+      for (uint32_t j = 0; j < configurations.size (); j++)
+        {
+          const Configuration & b = configurations[j];
+          if (b.throughput >= a.throughput && b.delay <= a.delay
+              && (b.throughput > a.throughput || b.delay < a.delay))
+            {
+              a.dominatedBy++;
+            }
+        }
+    }
+}
 
+bool
+StdmaTuner::ParetoLess (const Configuration & a, const Configuration & b)
+{
+  return a.dominatedBy != b.dominatedBy ? a.dominatedBy < b.dominatedBy : a.throughput > b.throughput;
 }
 
-void Experiment::CourseChange (std::ostream *os, std::string foo, Ptr<const MobilityModel> mobility)
+bool
+StdmaTuner::Run (uint32_t nConfigurations, ExperimentSweep sweep, std::string csvFileName)
 {
-  Vector pos = mobility->GetPosition (); // Get position
-  Vector vel = mobility->GetVelocity (); // Get velocity
+  std::vector<Configuration> configurations;
+  for (uint32_t i = 0; i < nConfigurations; i++)
+    {
+      configurations.push_back (Sample ());
+    }
 
+  std::ofstream log (csvFileName.c_str ());
+  log << "Rung,Budget,FrameDuration,ReportRate,SelectionInterval,MinCandidates,"
+      << "TimeoutMin,TimeoutMax,ThroughputKbps,MeanDelayMs,DominatedBy\n";
+  double budget = m_minBudget;
+  for (uint32_t rung = 0; !configurations.empty (); rung++)
+    {
+      ExperimentSweep runs = sweep;
+      for (uint32_t i = 0; i < configurations.size (); i++)
+        {
+          runs.AddPoint (Arguments (configurations[i], budget));
+        }
+      std::cout << "Rung " << rung << ": " << configurations.size ()
+                << " configurations, " << budget << " s each\n";
+      std::ostringstream rungFile;
+      rungFile << csvFileName << ".rung" << rung;
+      runs.Run (rungFile.str ());
+
+      // one row per completed run, in point order
+      std::vector<std::string> names;
+      names.push_back ("ThroughputKbps");
+      names.push_back ("MeanDelayMs");
+      std::vector<std::vector<double> > rows;
+      ReadSweepColumns (rungFile.str (), names, rows);
+      std::vector<Configuration> evaluated;
+      for (uint32_t i = 0, row = 0; i < configurations.size (); i++)
+        {
+          if (runs.Succeeded (i) && row < rows.size ())
+            {
+              configurations[i].throughput = rows[row][0];
+              configurations[i].delay = rows[row][1];
+              evaluated.push_back (configurations[i]);
+              row++;
+            }
+        }
+      std::remove (rungFile.str ().c_str ());
+      CountDominating (evaluated);
+      std::sort (evaluated.begin (), evaluated.end (), &StdmaTuner::ParetoLess);
+      for (uint32_t i = 0; i < evaluated.size (); i++)
+        {
+          const Configuration & c = evaluated[i];
+          log << rung << "," << budget << "," << c.frameDuration << "," << c.reportRate << ","
+              << c.selectionInterval << "," << c.minCandidates << "," << c.timeoutMin << ","
+              << c.timeoutMax << "," << c.throughput << "," << c.delay << "," << c.dominatedBy << "\n";
+        }
 
-  int nodeId = mobility->GetObject<Node> ()->GetId ();
-  double t = (Simulator::Now ()).GetSeconds ();
-  //NS_LOG_UNCOND ("Changing pos for node=" << nodeId << " at " << Simulator::Now () );
+      if (budget >= m_maxBudget || evaluated.size () <= 1)
+        {
+          std::cout << "Pareto front after " << budget << " s:\n"
+                    << "FrameDuration\tReportRate\tSelectionInterval\tMinCandidates\tTimeout\tkbps\tdelay ms\n";
+          for (uint32_t i = 0; i < evaluated.size () && evaluated[i].dominatedBy == 0; i++)
+            {
+              const Configuration & c = evaluated[i];
+              std::cout << c.frameDuration << "\t" << c.reportRate << "\t" << c.selectionInterval << "\t"
+                        << c.minCandidates << "\t" << c.timeoutMin << "-" << c.timeoutMax << "\t"
+                        << c.throughput << "\t" << c.delay << "\n";
+            }
+          return !evaluated.empty ();
+        }
 
-  // Prints position and velocities
-  *os << Simulator::Now () << " POS: x=" << pos.x << ", y=" << pos.y
-       << "; VEL:" << vel.x << ", y=" << vel.y << std::endl;
+      // keep the front, and at least 1/eta of the configurations
+      uint32_t keep = (evaluated.size () + m_eta - 1) / m_eta;
+      while (keep < evaluated.size () && evaluated[keep].dominatedBy == 0)
+        {
+          keep++;
+        }
+      evaluated.resize (keep);
+      configurations = evaluated;
+      budget = std::min (budget * m_eta, m_maxBudget);
+    }
+  return false;
 }
 
-void Experiment::CheckThroughput(){
-    
+/**
+ * \brief Reads every position, as a channel would for each transmission
+ * \param models the mobility models
+ * \param interval the time between two reads
+ * \param checksum accumulates the coordinates, so the reads are kept
+ * \return none
+ */
+static void
+QueryPositions (const std::vector<Ptr<MobilityModel> > *models, Time interval, double *checksum)
+{
+  for (uint32_t i = 0; i < models->size (); i++)
+    {
+      Vector position = (*models)[i]->GetPosition ();
+      *checksum += position.x + position.y;
+    }
+  Simulator::Schedule (interval, &QueryPositions, models, interval, checksum);
 }
 
-void Experiment::SetupLogFile(){
-  m_os.open (m_logFile.c_str ());
+/**
+ * \brief Times stock RandomWaypointMobilityModel objects against
+ * BatchMobilityEngine for the same random waypoint walk
+ * \param nNodes the number of nodes
+ * \return none
+ */
+static void
+RunMobilityBenchmark (uint32_t nNodes)
+{
+  const double duration = 60.0;
+  const Time interval = MilliSeconds (100);
+
+  std::cout << "Model\tNodes\tWallMs\tEvents\n";
+  for (uint32_t batch = 0; batch < 2; batch++)
+    {
+      Ptr<RandomBoxPositionAllocator> positions = CreateObject<RandomBoxPositionAllocator> ();
+      positions->SetAttribute ("X", StringValue ("ns3::UniformRandomVariable[Min=0.0|Max=1500.0]"));
+      positions->SetAttribute ("Y", StringValue ("ns3::UniformRandomVariable[Min=0.0|Max=1500.0]"));
+      positions->AssignStreams (0);
+
+      std::vector<Ptr<MobilityModel> > models;
+      Ptr<BatchMobilityEngine> engine;
+      double start = WallClockMs ();
+      if (batch)
+        {
+          engine = Create<BatchMobilityEngine> ();
+          engine->SetBounds (0.0, 1500.0, 0.0, 1500.0);
+          Ptr<UniformRandomVariable> speed = CreateObject<UniformRandomVariable> ();
+          speed->SetAttribute ("Min", DoubleValue (1.0));
+          speed->SetAttribute ("Max", DoubleValue (30.0));
+          Ptr<ConstantRandomVariable> pause = CreateObject<ConstantRandomVariable> ();
+          pause->SetAttribute ("Constant", DoubleValue (1.0));
+          engine->SetWalk (speed, pause);
+          engine->AssignStreams (10);
+          for (uint32_t i = 0; i < nNodes; i++)
+            {
+              Ptr<BatchMobilityModel> model = CreateObject<BatchMobilityModel> ();
+              model->SetEngine (engine);
+              model->SetPosition (positions->GetNext ());
+              models.push_back (model);
+            }
+        }
+      else
+        {
+          ObjectFactory factory;
+          factory.SetTypeId ("ns3::RandomWaypointMobilityModel");
+          factory.Set ("Speed", StringValue ("ns3::UniformRandomVariable[Min=1.0|Max=30.0]"));
+          factory.Set ("Pause", StringValue ("ns3::ConstantRandomVariable[Constant=1.0]"));
+          factory.Set ("PositionAllocator", PointerValue (positions));
+          int64_t stream = 10;
+          for (uint32_t i = 0; i < nNodes; i++)
+            {
+              Ptr<MobilityModel> model = factory.Create<MobilityModel> ();
+              model->SetPosition (positions->GetNext ());
+              stream += model->AssignStreams (stream);
+              model->Initialize ();
+              models.push_back (model);
+            }
+        }
+
+      double checksum = 0;
+      Simulator::Schedule (interval, &QueryPositions, &models, interval, &checksum);
+      Simulator::Stop (Seconds (duration));
+      Simulator::Run ();
+      uint64_t events = Simulator::GetEventCount ();
+      Simulator::Destroy ();
+      std::cout << (batch ? "batch" : "stock") << "\t" << nNodes << "\t"
+                << WallClockMs () - start << "\t" << events << "\n";
+    }
 }
 
-void Experiment::SetDefaultAttributeValues(){
+int main (int argc, char *argv[])
+{
+  // --sweep="protocol=1,2;nodes=10,50" [--jobs=N] runs every
+  // combination in parallel and merges them into --CSVfileName
+  std::vector<std::string> args (argv + 1, argv + argc);
+  std::string grid;
+  // --macBenchmark=10,50,100 runs CSMA and STDMA at each node count
+  std::string benchmarkNodes;
+  bool macBenchmark = ExtractArgument (args, "macBenchmark", benchmarkNodes);
+  if (macBenchmark)
+    {
+      grid = "macMode=0,1;nodes=" + benchmarkNodes;
+    }
+  if (ExtractArgument (args, "sweep", grid) || macBenchmark)
+    {
+      ExperimentSweep sweep;
+      std::string value;
+      if (ExtractArgument (args, "jobs", value))
+        {
+          sweep.SetJobs (std::atoi (value.c_str ()));
+        }
+      std::string csvFileName = macBenchmark ? "mac-benchmark.csv" : "experiment.output.csv";
+      ExtractArgument (args, "CSVfileName", csvFileName);
+      sweep.SetBaseArguments (argv[0], args);
+      sweep.AddGrid (grid);
+      bool ok = sweep.Run (csvFileName);
+      if (macBenchmark)
+        {
+          PrintMacBenchmark (csvFileName);
+        }
+      return ok ? 0 : 1;
+    }
 
-  Config::SetDefault ("ns3::OnOffApplication::PacketSize",StringValue ("64"));
-  Config::SetDefault ("ns3::OnOffApplication::DataRate",  StringValue (m_rate));
+  // --phyValidation="nodes=10,50" runs every point with the full error
+  // rate model and with PER tables and compares them; --jobs=1 keeps
+  // the wall times free of contention
+  std::string validationGrid;
+  if (ExtractArgument (args, "phyValidation", validationGrid))
+    {
+      ExperimentSweep sweep;
+      std::string value;
+      if (ExtractArgument (args, "jobs", value))
+        {
+          sweep.SetJobs (std::atoi (value.c_str ()));
+        }
+      std::string csvFileName = "phy-validation.csv";
+      ExtractArgument (args, "CSVfileName", csvFileName);
+      // the wall times compare the PHY tiers, not the NetAnim XML
+      // writer, so this overrides an explicit animMode
+      args.push_back ("--animMode=0");
+      sweep.SetBaseArguments (argv[0], args);
+      // phyFidelity varies fastest, so each pair of points is adjacent
+      sweep.AddGrid ("phyFidelity=0,1;" + validationGrid);
+      bool ok = sweep.Run (csvFileName);
+      PrintPhyValidation (csvFileName, sweep);
+      return ok ? 0 : 1;
+    }
 
-}
+  // --tuneStdma=27 [--tuneBudget=20,300] [--tuneEta=3] [--jobs=N]
+  // searches the STDMA attributes by successive halving
+  std::string tuneConfigurations;
+  if (ExtractArgument (args, "tuneStdma", tuneConfigurations))
+    {
+      ExperimentSweep sweep;
+      StdmaTuner tuner;
+      std::string value;
+      if (ExtractArgument (args, "jobs", value))
+        {
+          sweep.SetJobs (std::atoi (value.c_str ()));
+        }
+      std::string budget = "20,300";
+      ExtractArgument (args, "tuneBudget", budget);
+      std::string eta = "3";
+      ExtractArgument (args, "tuneEta", eta);
+      std::string::size_type comma = budget.find (',');
+      tuner.SetBudget (std::atof (budget.substr (0, comma).c_str ()),
+                       comma == std::string::npos ? std::atof (budget.c_str ()) : std::atof (budget.substr (comma + 1).c_str ()),
+                       std::atoi (eta.c_str ()));
+      std::string csvFileName = "stdma-tuning.csv";
+      ExtractArgument (args, "CSVfileName", csvFileName);
+      sweep.SetBaseArguments (argv[0], args);
+      return tuner.Run (std::atoi (tuneConfigurations.c_str ()), sweep, csvFileName) ? 0 : 1;
+    }
 
-void Experiment::ConfigureDevices(){
- //Already done in ConfigureChannels
-}
+  // --replaySchedulerTrace=scheduler.trace times a --schedulerTrace
+  // recording against every scheduler
+  std::string schedulerTrace;
+  if (ExtractArgument (args, "replaySchedulerTrace", schedulerTrace))
+    {
+      std::vector<RecordingScheduler::SchedulerTraceRecord> records;
+      if (!RecordingScheduler::Load (schedulerTrace, records))
+        {
+          std::cerr << "Unable to read " << schedulerTrace << "\n";
+          return 1;
+        }
+      const char *schedulers[] = { "map", "list", "heap", "calendar", "ladder" };
+      std::cout << "Replaying " << records.size () << " operations\n";
+      for (uint32_t i = 0; i < sizeof (schedulers) / sizeof (schedulers[0]); i++)
+        {
+          double ms = RecordingScheduler::Replay (records, SchedulerTypeId (schedulers[i]));
+          std::cout << schedulers[i] << "\t" << ms << " ms\t"
+                    << (records.empty () ? 0 : ms * 1e6 / records.size ()) << " ns/op\n";
+        }
+      return 0;
+    }
 
+  // --mobilityBenchmark=10000 compares stock and batched random waypoint
+  std::string benchmarkMobilityNodes;
+  if (ExtractArgument (args, "mobilityBenchmark", benchmarkMobilityNodes))
+    {
+      RunMobilityBenchmark (std::atoi (benchmarkMobilityNodes.c_str ()));
+      return 0;
+    }
 
+  // --convertMobilityTrace=experiment.mobility.bin writes the text form
+  // of a --traceMobility trace next to it
+  std::string mobilityTrace;
+  if (ExtractArgument (args, "convertMobilityTrace", mobilityTrace))
+    {
+      return MobilityTraceLogger::ConvertToText (mobilityTrace, mobilityTrace + ".txt") ? 0 : 1;
+    }
 
-int main (int argc, char *argv[])
-{
   Experiment experiment;
   experiment.Simulate (argc, argv);
 }
@@ -0,0 +1,198 @@
+#ifndef TABLE_ERROR_RATE_MODEL_H
+#define TABLE_ERROR_RATE_MODEL_H
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "ns3/core-module.h"
+#include "ns3/wifi-module.h"
+
+namespace ns3 {
+
+/**
+ * \brief Link-abstraction error rate model answering from tables
+ * precomputed with a detailed model.
+ *
+ * For every WifiMode, channel width, guard interval and number of
+ * spatial streams, the per-bit log success rate of the reference model
+ * is sampled once on a fixed SNR grid, shared by every instance with
+ * the same reference.  A chunk of n bits then succeeds with
+ * exp (n * L(snr)), which is exact for the (1 - p)^n form of the Nist
+ * and Yans models, so the frame size needs no table dimension; log(-L)
+ * is interpolated linearly in dB.  Each instance finds its tables by
+ * mode UID, without building a key per chunk.
+ *
+ * Include from the one source file of a program.
+ */
+class TableErrorRateModel : public ErrorRateModel
+{
+public:
+  /**
+   * \brief Get class TypeId
+   * \return the TypeId for the class
+   */
+  static TypeId GetTypeId (void);
+
+  /**
+   * \brief Constructor
+   * \return none
+   */
+  TableErrorRateModel ();
+
+  virtual double GetChunkSuccessRate (WifiMode mode, WifiTxVector txVector, double snr, uint32_t nbits) const;
+
+private:
+  /**
+   * \brief log(-L) samples of one mode, L the per-bit log success rate
+   */
+  typedef std::vector<double> Table;
+
+  /**
+   * \brief A shared table, with the TXVECTOR fields it was sampled for
+   */
+  struct CachedTable
+  {
+    uint32_t channelWidth;
+    bool shortGuardInterval;
+    uint8_t nss;
+    const Table *table;
+  };
+
+  /**
+   * \brief Returns the table of a mode and TXVECTOR, building it on
+   * first use
+   * \param mode the WifiMode
+   * \param txVector the TXVECTOR passed to the reference model
+   * \return the table
+   */
+  const Table & GetTable (WifiMode mode, WifiTxVector txVector) const;
+
+  /**
+   * \brief Samples the reference model into a shared table
+   * \param mode the WifiMode
+   * \param txVector the TXVECTOR passed to the reference model
+   * \return the table
+   */
+  const Table & BuildTable (WifiMode mode, WifiTxVector txVector) const;
+
+  static const double m_minSnrDb;
+  static const double m_maxSnrDb;
+  static const double m_stepDb;
+
+  std::string m_reference;
+  mutable Ptr<ErrorRateModel> m_referenceModel;
+  // by mode UID; one entry per TXVECTOR seen with the mode
+  mutable std::vector<std::vector<CachedTable> > m_cache;
+  // reference TypeId, mode name and TXVECTOR fields -> table
+  static std::map<std::string, Table> m_tables;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (TableErrorRateModel);
+
+const double TableErrorRateModel::m_minSnrDb = -10.0;
+const double TableErrorRateModel::m_maxSnrDb = 50.0;
+const double TableErrorRateModel::m_stepDb = 0.1;
+std::map<std::string, TableErrorRateModel::Table> TableErrorRateModel::m_tables;
+
+TypeId
+TableErrorRateModel::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::TableErrorRateModel")
+    .SetParent<ErrorRateModel> ()
+    .AddConstructor<TableErrorRateModel> ()
+    .AddAttribute ("Reference",
+                   "TypeId of the error rate model the tables are computed with",
+                   StringValue ("ns3::NistErrorRateModel"),
+                   MakeStringAccessor (&TableErrorRateModel::m_reference),
+                   MakeStringChecker ());
+  return tid;
+}
+
+TableErrorRateModel::TableErrorRateModel ()
+  : m_reference ("ns3::NistErrorRateModel")
+{
+}
+
+const TableErrorRateModel::Table &
+TableErrorRateModel::GetTable (WifiMode mode, WifiTxVector txVector) const
+{
+  uint32_t uid = mode.GetUid ();
+  if (uid >= m_cache.size ())
+    {
+      m_cache.resize (uid + 1);
+    }
+  std::vector<CachedTable> & entries = m_cache[uid];
+  for (uint32_t i = 0; i < entries.size (); i++)
+    {
+      if (entries[i].channelWidth == txVector.GetChannelWidth ()
+          && entries[i].shortGuardInterval == txVector.IsShortGuardInterval ()
+          && entries[i].nss == txVector.GetNss ())
+        {
+          return *entries[i].table;
+        }
+    }
+  CachedTable entry;
+  entry.channelWidth = txVector.GetChannelWidth ();
+  entry.shortGuardInterval = txVector.IsShortGuardInterval ();
+  entry.nss = txVector.GetNss ();
+  entry.table = &BuildTable (mode, txVector);
+  entries.push_back (entry);
+  return *entry.table;
+}
+
+const TableErrorRateModel::Table &
+TableErrorRateModel::BuildTable (WifiMode mode, WifiTxVector txVector) const
+{
+  std::ostringstream key;
+  key << m_reference << "/" << mode.GetUniqueName () << "/" << txVector.GetChannelWidth ()
+      << (txVector.IsShortGuardInterval () ? "/sgi/" : "/lgi/") << (uint32_t) txVector.GetNss ();
+  std::map<std::string, Table>::iterator it = m_tables.find (key.str ());
+  if (it != m_tables.end ())
+    {
+      return it->second;
+    }
+  if (m_referenceModel == 0)
+    {
+      ObjectFactory factory;
+      factory.SetTypeId (m_reference);
+      m_referenceModel = factory.Create<ErrorRateModel> ();
+    }
+  Table & table = m_tables[key.str ()];
+  uint32_t n = static_cast<uint32_t> ((m_maxSnrDb - m_minSnrDb) / m_stepDb + 0.5) + 1;
+  for (uint32_t i = 0; i < n; i++)
+    {
+      double snr = std::pow (10.0, (m_minSnrDb + i * m_stepDb) / 10.0);
+      double success = m_referenceModel->GetChunkSuccessRate (mode, txVector, snr, 1);
+      // -745 stands for a bit error rate too small for a double
+      double logFailure = success >= 1.0 ? -745.0 : std::log (-std::log (std::max (success, 1e-300)));
+      table.push_back (logFailure);
+    }
+  return table;
+}
+
+double
+TableErrorRateModel::GetChunkSuccessRate (WifiMode mode, WifiTxVector txVector, double snr, uint32_t nbits) const
+{
+  if (nbits == 0)
+    {
+      return 1.0;
+    }
+  const Table & table = GetTable (mode, txVector);
+  double position = (10.0 * std::log10 (std::max (snr, 1e-30)) - m_minSnrDb) / m_stepDb;
+  position = std::min (std::max (position, 0.0), double (table.size () - 1));
+  uint32_t i = static_cast<uint32_t> (position);
+  if (i + 1 >= table.size ())
+    {
+      i = table.size () - 2;
+    }
+  double f = position - i;
+  double logFailure = table[i] + f * (table[i + 1] - table[i]);
+  return std::exp (-std::exp (logFailure) * nbits);
+}
+
+} // namespace ns3
+
+#endif /* TABLE_ERROR_RATE_MODEL_H */
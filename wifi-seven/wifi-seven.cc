@@ -10,6 +10,8 @@
 #include "ns3/netanim-module.h"
 #include "ns3/flow-monitor-module.h"
 #include "ns3/wifi-module.h"
+#include <map>
+#include "../table-error-rate-model.h"
 
 
 using namespace ns3;
@@ -22,14 +24,21 @@ int main(int argc, char* argv[]){
     uint32_t nPackets = 1;
     uint32_t packetSize = 1024;
     bool verbose = false;
+    std::string scheduler = "ns3::MapScheduler";
+    uint32_t phyFidelity = 0;
     CommandLine cmd;
 
     cmd.AddValue ("Wifi", "Number of Wifi STA devices", nWifi);
     cmd.AddValue ("nPackets", "Number of packets to be sent from each station device", nPackets);
     cmd.AddValue ("packetSize", "Size of Each packet",packetSize);
     cmd.AddValue ("verbose","Enable Applcation Logging",verbose);
+    cmd.AddValue ("scheduler", "Event scheduler TypeId, e.g. ns3::HeapScheduler or ns3::CalendarScheduler", scheduler);
+    cmd.AddValue ("phyFidelity", "0=full Nist error rate model;1=precomputed PER tables", phyFidelity);
     cmd.Parse (argc,argv);
 
+    ObjectFactory schedulerFactory;
+    schedulerFactory.SetTypeId (scheduler);
+    Simulator::SetScheduler (schedulerFactory);
     
 
     //Enable Log for applications
@@ -56,6 +65,10 @@ int main(int argc, char* argv[]){
     YansWifiChannelHelper wifiChannel = YansWifiChannelHelper::Default();
     YansWifiPhyHelper phy = YansWifiPhyHelper::Default();
     phy.SetChannel(wifiChannel.Create());
+    if (phyFidelity == 1)
+      {
+        phy.SetErrorRateModel ("ns3::TableErrorRateModel");
+      }
 
     WifiHelper wifi;
     wifi.SetRemoteStationManager ("ns3::AarfWifiManager");
@@ -141,7 +154,10 @@ int main(int argc, char* argv[]){
 
     AnimationInterface anim ("wifi-seven.xml");
     
+    SystemWallClockMs runClock;
+    runClock.Start ();
     Simulator::Run ();
+    int64_t runMs = runClock.End ();
 
     monitor->CheckForLostPackets();
     Ptr<Ipv4FlowClassifier> classifier = DynamicCast<Ipv4FlowClassifier> (flowmon.GetClassifier ());
@@ -168,6 +184,7 @@ int main(int argc, char* argv[]){
     std::cout << "Distinct packet flows: "<<totalflows<<"\n";
     std::cout <<"Average Throughput: "<<avgThroughput/totalflows<<"\n";
     std::cout << "Total Packets Lost: " << lostPackets<<"\n";
+    std::cout << "Run wall time: " << runMs << " ms (phyFidelity=" << phyFidelity << ")\n";
     Simulator::Destroy ();
     return 0;
 }
\ No newline at end of file